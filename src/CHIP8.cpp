@@ -1,19 +1,65 @@
 #include "CHIP8.hpp"
-#include <SDL3/SDL.h>
+#include "jit.hpp"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <random>
 using namespace std;
 
+//Rotate a 64 bit row right, used to place sprite bytes with horizontal wrap
+static inline uint64_t rotateRow(uint64_t row, unsigned shift) {
+    shift &= 63u;
+    return (row >> shift) | (row << ((64u - shift) & 63u));
+}
+
+//Addresses the pc fetches from: classic and SUPER-CHIP programs wrap at 4 KB, as the pre-decoded,
+//JIT and lane engines do, XO-CHIP addresses all 64 KB
+static inline unsigned fetchMask(Mode mode) {
+    return mode == Mode::XoChip ? 0xFFFFu : 0x0FFFu;
+}
+
+//Compile-time behaviour of each Quirks profile, the op_* templates test it with if constexpr
+template<Quirks Q> struct quirkProfile;
+
+template<> struct quirkProfile<Quirks::Default> {
+    static constexpr bool resetVF = true;           //8XY1/8XY2/8XY3 clear VF
+    static constexpr bool shiftVY = true;           //8XY6/8XYE shift VY into VX, otherwise VX in place
+    static constexpr bool moveIndex = true;         //FX55/FX65 advance I ...
+    static constexpr int indexStep = 1;             //... by X + indexStep
+    static constexpr bool jumpVX = false;           //BXNN jumps to XNN + VX instead of NNN + V0
+    static constexpr bool clipSprites = false;      //DXYN clips at the screen edge instead of wrapping
+};
+
+template<> struct quirkProfile<Quirks::Vip> : quirkProfile<Quirks::Default> {
+    static constexpr bool clipSprites = true;
+};
+
+template<> struct quirkProfile<Quirks::Chip48> : quirkProfile<Quirks::Default> {
+    static constexpr bool resetVF = false;
+    static constexpr bool shiftVY = false;
+    static constexpr int indexStep = 0;
+    static constexpr bool jumpVX = true;
+    static constexpr bool clipSprites = true;
+};
+
+template<> struct quirkProfile<Quirks::SuperChip> : quirkProfile<Quirks::Chip48> {
+    static constexpr bool moveIndex = false;
+};
+
+template<> struct quirkProfile<Quirks::XoChip> : quirkProfile<Quirks::Default> {
+    static constexpr bool resetVF = false;
+};
+
 //Execute machine lanague subroutine at address NNN (does nothing in emulator)
 void chip8::op_0NNN() {}
 
-//Clear the screen
+//Clear the screen (32 rows of 64 bits, a single 256 byte wipe)
 void chip8::op_00E0() { 
-    for(int j = 0; j < 32; j++) {
-        for(int i = 0; i < 64; i++) {
-            chip8Screen[i + j * 64] = 0;  
-        }
+    for(int i = 0; i < 32; i++) {
+        if(chip8Screen[i]) dirtyRows |= 1u << i;
     }
+    memset(chip8Screen, 0, sizeof(chip8Screen));
 }
 
 //Return from a subroutine
@@ -88,34 +134,40 @@ void chip8::op_8XY0() {
     registers[X] = VY; 
 }
 
-//Set VX to (VX OR VY)
+//Set VX to (VX OR VY), VF is cleared in the profiles with the VF reset quirk
+template<Quirks Q>
 void chip8::op_8XY1() {
     uint8_t VY = registers[(opcode & 0x00F0u) >> 4u]; 
     uint8_t VX = registers[(opcode & 0x0F00u) >> 8u];
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
 
     registers[X] = (VY | VX); 
-    registers[0xF] = 0;
+    if constexpr(quirkProfile<Q>::resetVF) 
+        registers[0xF] = 0;
 }
 
-//Set VX to (VX AND VY) 
+//Set VX to (VX AND VY), VF is cleared in the profiles with the VF reset quirk
+template<Quirks Q>
 void chip8::op_8XY2() {
     uint8_t VY = registers[(opcode & 0x00F0u) >> 4u]; 
     uint8_t VX = registers[(opcode & 0x0F00u) >> 8u];
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
 
     registers[X] = (VY & VX);
-    registers[0xF] = 0;
+    if constexpr(quirkProfile<Q>::resetVF) 
+        registers[0xF] = 0;
 }
 
-//Set VX to (VX XOR VY)
+//Set VX to (VX XOR VY), VF is cleared in the profiles with the VF reset quirk
+template<Quirks Q>
 void chip8::op_8XY3() {
     uint8_t VY = registers[(opcode & 0x00F0u) >> 4u]; 
     uint8_t VX = registers[(opcode & 0x0F00u) >> 8u];
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
 
     registers[X] = (VY ^ VX); 
-    registers[0xF] = 0;
+    if constexpr(quirkProfile<Q>::resetVF) 
+        registers[0xF] = 0;
 }
 
 //ADD register VY to register VX 
@@ -142,11 +194,12 @@ void chip8::op_8XY5() {
     registers[0xF] = (borrow) ? 0 : 1; 
 }
 
-//Store the value of VY right shifted in VX
+//Store the value of VY right shifted in VX (CHIP-48 and SUPER-CHIP shift VX in place)
 //Set VF to the LSB prior to the bitshift 
 //VY is unchanged
+template<Quirks Q>
 void chip8::op_8XY6() {
-    uint8_t Y = (opcode & 0x00F0u) >> 4u; 
+    uint8_t Y = quirkProfile<Q>::shiftVY ? (opcode & 0x00F0u) >> 4u : (opcode & 0x0F00u) >> 8u; 
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
     uint8_t rsy = registers[Y] >> 1u; 
     uint8_t lsb = registers[Y] & 0x01; 
@@ -166,11 +219,12 @@ void chip8::op_8XY7() {
     registers[0xF] = (registers[Y] < registers[X]) ? 0 : 1; 
 }
 
-//Store the value of VY shifted left in VX 
+//Store the value of VY shifted left in VX (CHIP-48 and SUPER-CHIP shift VX in place)
 //Set VF to the MSB prior to shift 
 //VY is unchanged
+template<Quirks Q>
 void chip8::op_8XYE() {
-    uint8_t Y = (opcode & 0x00F0u) >> 4u;
+    uint8_t Y = quirkProfile<Q>::shiftVY ? (opcode & 0x00F0u) >> 4u : (opcode & 0x0F00u) >> 8u;
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
     uint8_t lsy = registers[Y] << 1u; 
     uint8_t msb = (registers[Y] & 0x80) >> 7u; 
@@ -194,34 +248,45 @@ void chip8::op_ANNN() {
 }
 
 //Jump to address NNN + V0 (set PC = NNN + V0)
+//CHIP-48 and SUPER-CHIP read it as BXNN and add VX instead
+template<Quirks Q>
 void chip8::op_BNNN() {
-    pc = registers[0x0] + (opcode & 0x0FFFu);
+    uint8_t X = quirkProfile<Q>::jumpVX ? (opcode & 0x0F00u) >> 8u : 0x0; 
+    pc = registers[X] + (opcode & 0x0FFFu);
 }
 
 //Set VX to a random number with a mask of NN 
 void chip8::op_CXNN() {
-    uint8_t randByte = dist(gen);
+    uint8_t randByte = randomByte();
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
     registers[X] = randByte & (opcode & 0x00FFu); 
 }
 
 //Draw a sprite at position VX, VY with N bytes of sprite data starting at the address stored in I
 //Set VF to 01 if any set pixels are changed to unset, and 00 otherwise
+//Each sprite byte is rotated into place and XORed into its row in one operation
+//With the clipping quirk the start position still wraps, but pixels past the right or bottom edge are dropped
+template<Quirks Q>
 void chip8::op_DXYN() {
-    int Xpos = registers[(opcode & 0x0F00u) >> 8u]; 
-    int Ypos = registers[(opcode & 0x00F0u) >> 4u]; 
-
-    registers[0xF] = 0; 
-    for(int i = 0; i < (opcode & 0xF); i++) {
-        uint8_t spriteByte = memory[indreg + i];
-        for(int j = 0; j < 8; j++) {
-            int Xcur = (Xpos + j) % 64;
-            int Ycur = (Ypos + i) % 32;
-            int curBit = (spriteByte >> (7u - j)) & 0x1;
-            if(chip8Screen[(Ycur)*64 + Xcur] & curBit) registers[0xF] = 1;
-            chip8Screen[(Ycur)*64 + Xcur] ^= curBit;
+    unsigned Xpos = registers[(opcode & 0x0F00u) >> 8u] & 63u; 
+    unsigned Ypos = registers[(opcode & 0x00F0u) >> 4u]; 
+    bool collision = false;
+
+    for(unsigned i = 0; i < (opcode & 0xFu); i++) {
+        uint64_t sprite;
+        if constexpr(quirkProfile<Q>::clipSprites) {
+            if(((Ypos & 31u) + i) > 31u) 
+                break;
+            sprite = (uint64_t(memory[(indreg + i) & 0x0FFFu]) << 56u) >> Xpos;
         }
+        else 
+            sprite = rotateRow(uint64_t(memory[(indreg + i) & 0x0FFFu]) << 56u, Xpos);
+        uint64_t &row = chip8Screen[(Ypos + i) & 31u];
+        collision |= (row & sprite) != 0;
+        row ^= sprite;
+        if(sprite) dirtyRows |= 1u << ((Ypos + i) & 31u);
     }
+    registers[0xF] = collision ? 1 : 0;
 }
 
 //Skip the following instruction if the key corresponding to the hex value currently stored in register VX is pressed
@@ -290,37 +355,51 @@ void chip8::op_FX33() {
     memory[indreg] = hund;
     memory[indreg + 1] = tens;
     memory[indreg + 2] = ones;
+    if(decodeCache || recompiler) invalidateCode(indreg, 3);
 }
 
 //Store the values of registers V0 to VX inclusive in memory starting at address I
-//I is set to I + X + 1 after operation
+//I is set to I + X + 1 after operation (I + X on CHIP-48, unchanged on SUPER-CHIP)
+template<Quirks Q>
 void chip8::op_FX55() {
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
     for(uint8_t V = 0; V <= X; V++) 
         memory[indreg + V] = registers[V];
-    indreg += X + 1;
+    if(decodeCache || recompiler) invalidateCode(indreg, X + 1);
+    if constexpr(quirkProfile<Q>::moveIndex) 
+        indreg += X + quirkProfile<Q>::indexStep;
 }
 
 //Fill registers V0 to VX inclusive with the values stored in memory starting at address I
-//I is set to I + X + 1 after operation
+//I is set to I + X + 1 after operation (I + X on CHIP-48, unchanged on SUPER-CHIP)
+template<Quirks Q>
 void chip8::op_FX65() {
     uint8_t X = (opcode & 0x0F00u) >> 8u; 
     for(uint8_t V = 0; V <= X; V++) 
         registers[V] = memory[indreg + V]; 
-    indreg += X + 1;
+    if constexpr(quirkProfile<Q>::moveIndex) 
+        indreg += X + quirkProfile<Q>::indexStep;
 }
 
+//The pre-decoded engine calls these handlers directly, it only runs the Default profile
+template void chip8::op_DXYN<Quirks::Default>();
+template void chip8::op_FX55<Quirks::Default>();
+template void chip8::op_FX65<Quirks::Default>();
+
 // Constructor for CHIP8 class, calls initialize()
-chip8::chip8() : display() {
+chip8::chip8() {
     initialize(); 
 }
 
+// Destructor, defined here where the recompiler type is complete
+chip8::~chip8() = default;
+
 // Initializes the basic characters stored in CHIP-8 memory from 0x0 to 0x0200
 // Initialize registers, random device seed, sets pc = 0x0200 to start program
 void chip8::initialize() {
     random_device rd; 
-    gen = mt19937(rd());
-    dist = uniform_int_distribution<uint8_t> (0,255u); 
+    setSeed(rd());
+    cycles = 0;
     pc = 0x0200;
     uint8_t array[80] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, 
@@ -343,10 +422,29 @@ void chip8::initialize() {
 
     for(uint16_t i = 0x0050; i <= 0x009F; i++) 
         memory[i] = array[i - 0x0050]; 
+    flushCode();
 }
 
-// Decodes the opcodes and executes the instruction
+// Decodes the opcodes and executes the instruction with the selected quirks profile
 void chip8::decodeExe(uint16_t opcode) {
+#if defined(CHIP8_TELEMETRY)
+    if(opcodeCounts) 
+        opcodeCounts[opcode]++;
+#endif
+    switch(quirks) {
+        case Quirks::Default: execute<Quirks::Default>(opcode); break;
+        case Quirks::Vip: execute<Quirks::Vip>(opcode); break;
+        case Quirks::Chip48: execute<Quirks::Chip48>(opcode); break;
+        case Quirks::SuperChip: execute<Quirks::SuperChip>(opcode); break;
+        case Quirks::XoChip: execute<Quirks::XoChip>(opcode); break;
+    }
+}
+
+// Executes one instruction, the quirks of profile Q are resolved at compile time
+template<Quirks Q>
+void chip8::execute(uint16_t opcode) {
+    if(mode != Mode::Chip8 && decodeExtended(opcode))
+        return;
     switch(opcode & 0xF000) {
         case 0x0: 
             if(opcode==0x00E0) op_00E0(); 
@@ -362,21 +460,24 @@ void chip8::decodeExe(uint16_t opcode) {
         case 0x8000:
             switch(opcode & 0x000F) {
                 case 0x0: op_8XY0(); break;
-                case 0x1: op_8XY1(); break;
-                case 0x2: op_8XY2(); break;
-                case 0x3: op_8XY3(); break;
+                case 0x1: op_8XY1<Q>(); break;
+                case 0x2: op_8XY2<Q>(); break;
+                case 0x3: op_8XY3<Q>(); break;
                 case 0x4: op_8XY4(); break;
                 case 0x5: op_8XY5(); break;
-                case 0x6: op_8XY6(); break;
+                case 0x6: op_8XY6<Q>(); break;
                 case 0x7: op_8XY7(); break;
-                case 0xE: op_8XYE(); break;
+                case 0xE: op_8XYE<Q>(); break;
             }
             break;
         case 0x9000: op_9XY0(); break;
         case 0xA000: op_ANNN(); break;
-        case 0xB000: op_BNNN(); break;
+        case 0xB000: op_BNNN<Q>(); break;
         case 0xC000: op_CXNN(); break;
-        case 0xD000: op_DXYN(); break;
+        case 0xD000:
+            if(mode != Mode::Chip8) op_extendedDXYN(!quirkProfile<Q>::clipSprites);
+            else op_DXYN<Q>();
+            break;
         case 0xE000: 
             if((opcode & 0x00FF) == 0x9E) op_EX9E();
             else if((opcode & 0x00FF) == 0xA1) op_EXA1();
@@ -390,38 +491,10 @@ void chip8::decodeExe(uint16_t opcode) {
                 case 0x1E: op_FX1E(); break;
                 case 0x29: op_FX29(); break;
                 case 0x33: op_FX33(); break;
-                case 0x55: op_FX55(); break;
-                case 0x65: op_FX65(); break;
-            }
-    }
-}
-// Function to inputBuffer located in Graphics class
-void chip8::inputBuffer(SDL_Event keyEvent) {
-    display.inputBuffer(keypad, keyEvent);
-}
-
-// Function to update the display, actually draws to the screen
-void chip8::updateDisplay() {
-    int pitch = display.getPitch();
-    uint8_t *framebuffer = display.accessPixels(); 
-
-    for(int i = 0; i < 32; i++) {
-        for(int j = 0; j < 64; j++) {
-            if(chip8Screen[64*i + j]) {
-                framebuffer[pitch*i + 4*j] = 255;
-                framebuffer[pitch*i + 4*j + 1] = 0;
-                framebuffer[pitch*i + 4*j + 2] = 200;
-                framebuffer[pitch*i + 4*j + 3] = 255;
-            } else {
-                framebuffer[pitch*i + 4*j] = 255;
-                framebuffer[pitch*i + 4*j + 1] = 25;
-                framebuffer[pitch*i + 4*j + 2] = 25;
-                framebuffer[pitch*i + 4*j + 3] = 25;
+                case 0x55: op_FX55<Q>(); break;
+                case 0x65: op_FX65<Q>(); break;
             }
-        }
     }
-    display.updatePixels();
-    display.updateScreen(registers, stack, pc);
 }
 // Decrement timers
 void chip8::decrementCounters() {
@@ -432,24 +505,259 @@ void chip8::decrementCounters() {
     }
 }
 
-// Generate audio array
-void chip8::generateAudio() {
-    playAudio = (soundTimer > 0);
-    display.generateAudio(playAudio);
+// Return the keypad state so a frontend can write key presses into it
+uint8_t* chip8::getKeypad() {
+    return keypad;
+}
+
+// Return the 64x32 display, 32 rows with bit 63 as the leftmost pixel
+const uint64_t* chip8::getScreen() const {
+    return chip8Screen;
+}
+
+// Return the rows changed by op_DXYN/op_00E0 since the last call, then reset them
+uint32_t chip8::takeDirtyRows() {
+    uint32_t rows = dirtyRows;
+    dirtyRows = 0;
+    return rows;
+}
+
+// FNV-1a hash of the 256 byte display, for comparing final frames across runs
+uint64_t chip8::screenHash() const {
+    if(mode != Mode::Chip8)
+        return hashScreen(&planes[0][0][0], sizeof(planes) / sizeof(uint64_t));
+    return hashScreen(chip8Screen);
+}
+
+// FNV-1a hash of a display of words 64-bit words, 32 for the classic display
+uint64_t chip8::hashScreen(const uint64_t *screen, size_t words) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(screen);
+    for(size_t i = 0; i < words * sizeof(uint64_t); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Return the general purpose registers V0 - VF
+const uint8_t* chip8::getRegisters() const {
+    return registers;
+}
+
+// Return the call stack
+const uint16_t* chip8::getStack() const {
+    return stack;
+}
+
+// Return the call depth, the number of return addresses on the stack
+uint8_t chip8::getSP() const {
+    return sp;
+}
+
+// Return the number of instructions executed since initialize
+uint64_t chip8::getCycles() const {
+    return cycles;
+}
+
+// Return the 4 KB memory
+const uint8_t* chip8::getMemory() const {
+    return memory;
+}
+
+// Return the program counter
+uint16_t chip8::getPC() const {
+    return pc;
 }
 
-// Take sound from audio array and play it
-void chip8::playSound() {
-    display.playSound(playAudio); 
+// Return true while the sound timer is running (beep should be playing)
+bool chip8::soundActive() const {
+    return soundTimer > 0;
 }
 
 // Implements the Fetch -> decode -> execute cycle 
 void chip8::emulateCycle() {
-    opcode = (memory[pc] << 8u) + memory[pc+1]; 
+    unsigned mask = fetchMask(mode);
+    opcode = (memory[pc & mask] << 8u) + memory[(pc + 1) & mask]; 
     pc += 2; 
     decodeExe(opcode);
 }
 
+// Fetch -> decode -> execute count instructions with the quirks of profile Q compiled in
+template<Quirks Q>
+void chip8::interpret(long long count) {
+    const unsigned mask = fetchMask(mode);
+    for(long long i = 0; i < count; i++) {
+        opcode = (memory[pc & mask] << 8u) + memory[(pc + 1) & mask]; 
+        pc += 2; 
+        execute<Q>(opcode);
+    }
+}
+
+// Run count instructions on the interpreter, the profile is picked once per batch rather than per instruction
+void chip8::runInterpreter(long long count) {
+    switch(quirks) {
+        case Quirks::Default: interpret<Quirks::Default>(count); break;
+        case Quirks::Vip: interpret<Quirks::Vip>(count); break;
+        case Quirks::Chip48: interpret<Quirks::Chip48>(count); break;
+        case Quirks::SuperChip: interpret<Quirks::SuperChip>(count); break;
+        case Quirks::XoChip: interpret<Quirks::XoChip>(count); break;
+    }
+}
+
+// Skip whole iterations of a wait loop at pc, returns the number of instructions skipped
+// Timers and keys do not change inside runCycles, so every iteration of these loops leaves the machine
+// exactly as the first one did: a jump to self, FX0A with no key held, and FX07 / 3XNN or 4XNN / 1NNN
+// polling the delay timer while the skip does not fire. pc may be anywhere in the polling loop, the
+// instructions before its FX07 run on the interpreter first.
+long long chip8::skipIdleLoop(long long count) {
+    auto word = [this](int address) { return uint16_t((memory[address] << 8u) | memory[address + 1]); };
+    if(pc > 4094)
+        return 0;
+    uint16_t here = word(pc);
+    if(here == (0x1000u | pc) || ((here & 0xF0FFu) == 0xF00Au && none_of(keypad, keypad + 16, [](uint8_t k) { return k != 0; }))) {
+        opcode = here;
+        return count;
+    }
+
+    for(int start = pc; start >= pc - 4 && start >= 0; start -= 2) {
+        if(start > 4090)
+            continue;
+        uint16_t poll = word(start), test = word(start + 2), jump = word(start + 4);
+        uint16_t X = (poll & 0x0F00u) >> 8u;
+        bool skipTest = (test & 0xF000u) == 0x3000u || (test & 0xF000u) == 0x4000u;
+        if((poll & 0xF0FFu) != 0xF007u || !skipTest || ((test & 0x0F00u) >> 8u) != X || jump != (0x1000u | start))
+            continue;
+        long long done = 0;
+        for(; pc != start && done < count; done++)
+            emulateCycle();
+        if(pc != start)
+            return done;
+        bool exits = (test & 0xF000u) == 0x3000u ? delay == (test & 0x00FFu) : delay != (test & 0x00FFu);
+        long long iterations = (count - done) / 3;
+        if(exits || iterations == 0)
+            return done;
+        registers[X] = delay;
+        opcode = jump;
+        return done + iterations * 3;
+    }
+    return 0;
+}
+
+// Execute count instructions with the selected engine
+// The extended modes and quirks profiles other than Default always use the interpreter
+// Timers are not ticked, callers run decrementCounters once per 60 Hz frame
+// Wait loops at the start of the batch are skipped, with the same result as running them
+void chip8::runCycles(long long count) {
+    if(count <= 0)
+        return;
+    cycles += count;
+#if defined(CHIP8_TELEMETRY)
+    if(opcodeCounts) {
+        for(long long i = 0; i < count; i++) 
+            emulateCycle();
+        return;
+    }
+#endif
+    count -= skipIdleLoop(count);
+    if(count <= 0)
+        return;
+    if(mode != Mode::Chip8 || quirks != Quirks::Default) {
+        runInterpreter(count);
+        return;
+    }
+    if(engine == Engine::Jit && jit::supported()) {
+        if(!recompiler) 
+            recompiler.reset(new jit(*this));
+        if(recompiler->run(count))
+            return;
+        engine = Engine::Predecoded;
+    }
+    if(engine != Engine::Interpreter) {
+        runPredecoded(count);
+        return;
+    }
+    runInterpreter(count);
+}
+
+// Run one 60 Hz frame: a batch of instructions followed by one timer tick
+void chip8::runFrame(int instructionsPerFrame) {
+    runCycles(instructionsPerFrame);
+    decrementCounters();
+}
+
+// Count every decoded instruction into counts[opcode] (65536 entries), null stops counting
+// Only builds with CHIP8_TELEMETRY count, elsewhere this does nothing
+void chip8::setOpcodeCounters(uint64_t *counts) {
+#if defined(CHIP8_TELEMETRY)
+    opcodeCounts = counts;
+#else
+    (void)counts;
+#endif
+}
+
+// Reseed the random number generator used by op_CXNN, for reproducible runs
+void chip8::setSeed(uint32_t seed) {
+    rng = seedState(seed);
+}
+
+// Generator state for a seed
+// The seed is mixed with splitmix64 so nearby seeds give unrelated sequences and the state is never zero
+uint64_t chip8::seedState(uint32_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (z ^ (z >> 31)) | 1u;
+}
+
+// Next byte from the xorshift64* generator, 8 bytes of state so save-states can copy it directly
+uint8_t chip8::randomByte() {
+    return nextRandom(rng);
+}
+
+// Advance a xorshift64* state and return the top byte of its output
+uint8_t chip8::nextRandom(uint64_t &state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (state * 0x2545F4914F6CDD1Dull) >> 56;
+}
+
+// Memory bytes [address, address + length) were written, drop code translated from them
+void chip8::invalidateCode(uint16_t address, uint16_t length) {
+    if(decodeCache) 
+        invalidateDecodeCache(address, length);
+    if(recompiler) 
+        recompiler->invalidate(address, length);
+}
+
+// All of memory may have changed, drop all pre-decoded and recompiled code
+void chip8::flushCode() {
+    flushDecodeCache();
+    if(recompiler) 
+        recompiler->flush();
+}
+
+// Select the compatibility profile, takes effect from the next instruction
+void chip8::setQuirks(Quirks quirks) {
+    this->quirks = quirks;
+}
+
+// Return the compatibility profile
+Quirks chip8::getQuirks() const {
+    return quirks;
+}
+
+// Select the engine used by runCycles, all engines share the same machine state
+void chip8::setEngine(Engine engine) {
+    this->engine = engine;
+}
+
+// Largest ROM that fits from 0x200: 4 KB of memory, 64 KB in XO-CHIP mode
+int chip8::romCapacity() const {
+    return (mode == Mode::XoChip ? MEMORY_SIZE : 4096) - 0x0200;
+}
+
 // Read ROM file data and stores into memory
 bool chip8::loadROM(const char* filename) {
     ifstream input(filename, ifstream::binary); 
@@ -461,12 +769,24 @@ bool chip8::loadROM(const char* filename) {
     int fileLength = input.tellg();
     input.seekg(0, input.beg);
     
-    if(fileLength > (4096 - 0x0200)) {
+    if(fileLength > romCapacity()) {
         cerr << "ROM cannot fit within emulator memory!" << endl;
         return false; 
     }
 
     input.read(reinterpret_cast<char*>(&memory[0x0200]), fileLength);
     input.close();
+    flushCode();
+    return true;
+}
+
+// Load a ROM image that is already in host memory, used when many instances run the same ROM
+bool chip8::loadROM(const uint8_t* data, size_t length) {
+    if(length > size_t(romCapacity())) {
+        cerr << "ROM cannot fit within emulator memory!" << endl;
+        return false;
+    }
+    memcpy(&memory[0x0200], data, length);
+    flushCode();
     return true;
-}
\ No newline at end of file
+}
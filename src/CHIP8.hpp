@@ -1,21 +1,111 @@
-#include "graphics.hpp"
-#include <random> 
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 using namespace std;
 
+//Interpreter engines selectable with chip8::setEngine
+//Interpreter: fetch, decodeExe and op_* on every instruction (reference implementation)
+//Predecoded: each 2-byte slot of memory is decoded once, then run with direct-threaded dispatch
+//Jit: basic blocks are recompiled to x86-64 code (falls back to Predecoded on other hosts)
+enum class Engine { Interpreter, Predecoded, Jit };
+
+//Instruction sets selectable with chip8::setMode, before the ROM is loaded
+//Chip8: the 35 classic opcodes on a 64x32 display with 4 KB of memory
+//SuperChip: adds 128x64 hires (00FE/00FF), scrolling (00CN, 00FB, 00FC), 16x16 sprites (DXY0),
+//the large font (FX30), user flags (FX75/FX85) and exit (00FD)
+//XoChip: SuperChip plus 00DN, 64 KB of memory, two bitplanes (FN01), F000 NNNN, 5XY2/5XY3
+//and the audio pattern buffer (F002, FX3A)
+//The extended modes always run on the reference interpreter
+enum class Mode : uint8_t { Chip8, SuperChip, XoChip };
+
+//Compatibility profiles selectable with chip8::setQuirks, they differ in five behaviours:
+//VF reset by 8XY1/8XY2/8XY3, 8XY6/8XYE shifting VY or VX, how far FX55/FX65 move I,
+//BNNN jumping to NNN + V0 or XNN + VX, and DXYN wrapping or clipping sprites at the screen edge
+//Default: the behaviour of this emulator so far (VIP arithmetic, wrapping sprites)
+//Vip: COSMAC VIP, Chip48: HP-48 CHIP-48, SuperChip: SUPER-CHIP 1.1, XoChip: Octo's XO-CHIP
+//Each profile is a separate instantiation of the interpreter, so the checks compile away; only
+//Default runs on the pre-decoded and JIT engines, the others always use the interpreter
+enum class Quirks : uint8_t { Default, Vip, Chip48, SuperChip, XoChip };
+
+static const uint32_t MEMORY_SIZE{0x10000};         //Addressable by XO-CHIP, classic programs use the first 4 KB
+
+class jit;
+
+/* Save-state, a fixed-layout snapshot of the whole machine
+ * Fields are stored in host byte order with no padding, so a snapshot is a handful of memcpy
+ * calls and a file is the struct written as-is. STATE_VERSION changes whenever the layout
+ * does, loadState rejects snapshots with a different magic, version or size.
+ *
+ * A snapshot only fills the part of the struct its mode uses, the first size bytes
+ * (chip8::stateSize): classic CHIP-8 ends after the 4 KB of memory, SUPER-CHIP after the
+ * bitplanes, and only XO-CHIP carries the memory above 4 KB. Files and rewind history keep
+ * just those bytes, so classic snapshots stay small enough to take every frame.
+ */
+static const uint32_t STATE_MAGIC{0x53533843u};     //"C8SS" when stored little-endian
+static const uint16_t STATE_VERSION{4};
+
+struct chip8State {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t mode;                           //Mode
+    uint8_t hires;
+    uint32_t size;                          //Bytes in use, chip8::stateSize(mode)
+    uint8_t planeMask;
+    uint8_t pitch;
+    uint8_t patternLoaded;
+    uint8_t reserved0;
+    uint64_t screen[32];
+    uint64_t rng;
+    uint64_t cycles;
+    uint16_t stack[16];
+    uint8_t registers[16];
+    uint8_t keypad[16];
+    uint8_t flags[16];
+    uint8_t audioPattern[16];
+    uint16_t indreg;
+    uint16_t pc;
+    uint16_t opcode;
+    uint8_t sp;
+    uint8_t delay;
+    uint8_t soundTimer;
+    uint8_t reserved[7];
+    uint8_t memory[4096];                   //Classic snapshots end here
+    uint64_t planes[2][64][2];              //SUPER-CHIP snapshots end here
+    uint8_t highMemory[MEMORY_SIZE - 4096];
+};
+static_assert(sizeof(chip8State) == 67984, "chip8State layout must not contain padding");
+
+//One pre-decoded instruction, see predecode.cpp
+struct decodedOp {
+    const void *handler;                    //Handler label (GNU C) or handler number (other compilers)
+    uint16_t opcode;
+    uint16_t NNN;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t NN;
+    uint8_t op;
+};
+
 /* CHIP-8 class definitions 
  * Variables: Stack, byte-addressable memory, general purpose registers, stack pointer, index register
  * sound timer, delay timer, display, opcodes 
  * 
+ * Classic programs draw to chip8Screen. The SUPER-CHIP and XO-CHIP modes draw to planes instead,
+ * each line a packed 128-bit row, so scrolling is a handful of word shifts and moves
+ * 
  * Private methods: instruction functions
  * 
- * Public methods: emulateCylce and initialize 
+ * Public methods: emulateCylce and initialize, plus read-only accessors for frontends
+ * 
+ * The core has no SDL dependency, presentation, input and audio live in the Graphics class 
  */
 
 class chip8 {
     //Emulation components 
     uint8_t registers[16]{};                
-    uint8_t memory[4096]{};                
-    uint16_t stack[16];                     
+    uint8_t memory[MEMORY_SIZE + 16]{};     //Slack past the end keeps I + X of FX33/FX55/FX65 in bounds
+    uint16_t stack[16]{};                   
     uint8_t sp{};                            
     uint16_t indreg{};                       
     uint16_t pc{};                          
@@ -23,11 +113,27 @@ class chip8 {
     uint8_t delay{};  
     uint8_t soundTimer{};                       
     uint8_t keypad[16]{}; 
-    int chip8Screen[64 * 32]{};
-    mt19937 gen; 
-    uniform_int_distribution<uint8_t> dist;
-    Graphics display{};
-    bool playAudio{false}; 
+    uint64_t chip8Screen[32]{};             //One word per row, bit 63 is the leftmost pixel
+    uint64_t planes[2][64][2]{};            //Extended modes: [plane][row][half] of a 128x64 display, lores pixels are 2x2
+    Mode mode{Mode::Chip8};
+    Quirks quirks{Quirks::Default};
+    bool hires{};                           //128x64 addressing in the extended modes
+    uint8_t planeMask{1};                   //Bitplanes selected by FN01, always 1 outside XO-CHIP
+    uint8_t pitch{64};                      //XO-CHIP audio pattern pitch, FX3A
+    bool patternLoaded{};                   //F002 has loaded audioPattern
+    uint8_t flags[16]{};                    //SUPER-CHIP user flags, FX75/FX85
+    uint8_t audioPattern[16]{};             //XO-CHIP 1-bit audio samples, most significant bit first
+    uint32_t dirtyRows{0xFFFFFFFFu};        //Bit i set when row i changed since the last takeDirtyRows()
+    uint64_t rng{};                         //xorshift64* state for op_CXNN, never zero
+    uint64_t cycles{};                      //Instructions executed through runCycles, the timebase for input logs
+    Engine engine{Engine::Interpreter};
+    unique_ptr<decodedOp[]> decodeCache;    //One entry per memory address, allocated on first use
+    const void *decodeHandler{};            //Handler that decodes an entry on its first execution
+    unique_ptr<jit> recompiler;             //Created on first use of Engine::Jit
+    friend class jit;
+#if defined(CHIP8_TELEMETRY)
+    uint64_t *opcodeCounts{};               //Executions per opcode, see telemetry.hpp
+#endif
 
     //Opcode method declarations, to be defined in CHIP.cpp 
 
@@ -47,23 +153,23 @@ class chip8 {
 
     //0x8XY0 through 0x9XY0
     void op_8XY0();
-    void op_8XY1(); 
-    void op_8XY2();
-    void op_8XY3();
+    template<Quirks Q> void op_8XY1(); 
+    template<Quirks Q> void op_8XY2();
+    template<Quirks Q> void op_8XY3();
     void op_8XY4(); 
     void op_8XY5(); 
-    void op_8XY6();
+    template<Quirks Q> void op_8XY6();
     void op_8XY7(); 
-    void op_8XYE(); 
+    template<Quirks Q> void op_8XYE(); 
     void op_9XY0(); 
 
     //0xANNN through 0xCXNN
     void op_ANNN(); 
-    void op_BNNN(); 
+    template<Quirks Q> void op_BNNN(); 
     void op_CXNN(); 
 
     //0xDXYN
-    void op_DXYN(); 
+    template<Quirks Q> void op_DXYN(); 
 
     //0xEX9E through 0xEXF2
     void op_EX9E(); 
@@ -77,19 +183,92 @@ class chip8 {
     void op_FX1E(); 
     void op_FX29();
     void op_FX33();
-    void op_FX55(); 
-    void op_FX65(); 
+    template<Quirks Q> void op_FX55(); 
+    template<Quirks Q> void op_FX65(); 
+
+    //SUPER-CHIP and XO-CHIP opcodes, defined in extended.cpp
+    void op_00CN();
+    void op_00DN();
+    void op_00FB();
+    void op_00FC();
+    void op_00FD();
+    void op_00FE();
+    void op_00FF();
+    void op_5XY2();
+    void op_5XY3();
+    void op_F000();
+    void op_FN01();
+    void op_F002();
+    void op_FX30();
+    void op_FX3A();
+    void op_FX75();
+    void op_FX85();
+    void op_extendedDXYN(bool wrap);
+    void op_extended00E0();
+    bool decodeExtended(uint16_t opcode);
+    void skipLongInstruction(uint16_t before);
     void decodeExe(uint16_t opcode); 
+    template<Quirks Q> void execute(uint16_t opcode);
+    template<Quirks Q> void interpret(long long count);
+    void runInterpreter(long long count);
+
+    //Pre-decoded engine, defined in predecode.cpp
+    void runPredecoded(long long count);
+    void invalidateDecodeCache(uint16_t address, uint16_t length);
+    void flushDecodeCache();
+
+    //Drop pre-decoded and recompiled code after writes to memory
+    void invalidateCode(uint16_t address, uint16_t length);
+    void flushCode();
+    uint8_t randomByte();
+    long long skipIdleLoop(long long count);
+    int romCapacity() const;
            
 //public methods 
 public: 
     chip8(); 
+    ~chip8();
     bool loadROM(const char * filename);
-    void inputBuffer(SDL_Event keyEvent); 
-    void updateDisplay();
+    bool loadROM(const uint8_t * data, size_t length);
     void initialize();
     void emulateCycle();
-    void generateAudio();
-    void playSound();
+    void runCycles(long long count);
+    void runFrame(int instructionsPerFrame);
+    void setSeed(uint32_t seed);
+    void setMode(Mode mode);
+    void setQuirks(Quirks quirks);
+
+//Machine-independent helpers, shared with the lane engine
+    static uint64_t seedState(uint32_t seed);
+    static uint8_t nextRandom(uint64_t &state);
+    static uint64_t hashScreen(const uint64_t *screen, size_t words = 32);
+
+//Save-states, defined in savestate.cpp
+    void saveState(chip8State &state) const;
+    bool loadState(const chip8State &state);
+    bool saveState(const char *filename) const;
+    bool loadState(const char *filename);
+    static size_t stateSize(Mode mode);
+    void setEngine(Engine engine);
+    void setOpcodeCounters(uint64_t *counts);
     void decrementCounters();
+
+//Accessors for frontends (SDL window, headless runner)
+    uint8_t *getKeypad();
+    const uint64_t *getScreen() const;
+    const uint64_t (*getPlanes() const)[64][2];
+    Mode getMode() const;
+    Quirks getQuirks() const;
+    bool isHires() const;
+    const uint8_t *getAudioPattern() const;
+    uint8_t getPitch() const;
+    uint64_t screenHash() const;
+    uint32_t takeDirtyRows();
+    const uint8_t *getRegisters() const;
+    const uint16_t *getStack() const;
+    uint8_t getSP() const;
+    const uint8_t *getMemory() const;
+    uint16_t getPC() const;
+    uint64_t getCycles() const;
+    bool soundActive() const;
 };
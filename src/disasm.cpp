@@ -0,0 +1,185 @@
+#include "disasm.hpp"
+#include <cstdio>
+using namespace std;
+
+// Format one SUPER-CHIP or XO-CHIP instruction, the decode in chip8::decodeExtended; false for the classic ones
+static bool disassembleExtended(uint16_t opcode, Mode mode, uint16_t next, char *text, size_t size) {
+    bool xo = mode == Mode::XoChip;
+    unsigned X = (opcode & 0x0F00u) >> 8u;
+    unsigned Y = (opcode & 0x00F0u) >> 4u;
+    unsigned N = opcode & 0x000Fu;
+    unsigned NN = opcode & 0x00FFu;
+
+    switch(opcode & 0xF000u) {
+        case 0x0000:
+            if((opcode & 0xFFF0u) == 0x00C0u) snprintf(text, size, "SCD %u", N);
+            else if(xo && (opcode & 0xFFF0u) == 0x00D0u) snprintf(text, size, "SCU %u", N);
+            else if(opcode == 0x00FBu) snprintf(text, size, "SCR");
+            else if(opcode == 0x00FCu) snprintf(text, size, "SCL");
+            else if(opcode == 0x00FDu) snprintf(text, size, "EXIT");
+            else if(opcode == 0x00FEu) snprintf(text, size, "LOW");
+            else if(opcode == 0x00FFu) snprintf(text, size, "HIGH");
+            else return false;
+            return true;
+        case 0x5000:
+            if(xo && N == 0x2) snprintf(text, size, "LD [I], V%X-V%X", X, Y);
+            else if(xo && N == 0x3) snprintf(text, size, "LD V%X-V%X, [I]", X, Y);
+            else return false;
+            return true;
+        case 0xF000:
+            if(xo && opcode == 0xF000u) snprintf(text, size, "LD I, 0x%04X", next);
+            else if(xo && opcode == 0xF002u) snprintf(text, size, "AUDIO");
+            else if(xo && NN == 0x01) snprintf(text, size, "PLANE %u", X);
+            else if(NN == 0x30) snprintf(text, size, "LD HF, V%X", X);
+            else if(xo && NN == 0x3A) snprintf(text, size, "PITCH V%X", X);
+            else if(NN == 0x75) snprintf(text, size, "LD R, V%X", X);
+            else if(NN == 0x85) snprintf(text, size, "LD V%X, R", X);
+            else return false;
+            return true;
+    }
+    return false;
+}
+
+// Format one instruction, operands follow the decode in chip8::decodeExe
+string disassemble(uint16_t opcode, Mode mode, Quirks quirks, uint16_t next) {
+    char text[32];
+    unsigned X = (opcode & 0x0F00u) >> 8u;
+    unsigned Y = (opcode & 0x00F0u) >> 4u;
+    unsigned N = opcode & 0x000Fu;
+    unsigned NN = opcode & 0x00FFu;
+    unsigned NNN = opcode & 0x0FFFu;
+
+    if(mode != Mode::Chip8 && disassembleExtended(opcode, mode, next, text, sizeof(text)))
+        return text;
+    switch(opcode & 0xF000u) {
+        case 0x0000:
+            if(opcode == 0x00E0) return "CLS";
+            if(opcode == 0x00EE) return "RET";
+            snprintf(text, sizeof(text), "SYS 0x%03X", NNN);
+            return text;
+        case 0x1000: snprintf(text, sizeof(text), "JP 0x%03X", NNN); return text;
+        case 0x2000: snprintf(text, sizeof(text), "CALL 0x%03X", NNN); return text;
+        case 0x3000: snprintf(text, sizeof(text), "SE V%X, 0x%02X", X, NN); return text;
+        case 0x4000: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", X, NN); return text;
+        case 0x5000: snprintf(text, sizeof(text), "SE V%X, V%X", X, Y); return text;
+        case 0x6000: snprintf(text, sizeof(text), "LD V%X, 0x%02X", X, NN); return text;
+        case 0x7000: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", X, NN); return text;
+        case 0x8000: {
+            static const char *const ALU[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                                nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr};
+            if(!ALU[N]) break;
+            snprintf(text, sizeof(text), "%s V%X, V%X", ALU[N], X, Y);
+            return text;
+        }
+        case 0x9000: snprintf(text, sizeof(text), "SNE V%X, V%X", X, Y); return text;
+        case 0xA000: snprintf(text, sizeof(text), "LD I, 0x%03X", NNN); return text;
+        case 0xB000:
+            //The jumpVX quirk of the CHIP-48 and SUPER-CHIP profiles, see quirkProfile in CHIP8.cpp
+            if(quirks == Quirks::Chip48 || quirks == Quirks::SuperChip)
+                snprintf(text, sizeof(text), "JP V%X, 0x%03X", X, NNN);
+            else
+                snprintf(text, sizeof(text), "JP V0, 0x%03X", NNN);
+            return text;
+        case 0xC000: snprintf(text, sizeof(text), "RND V%X, 0x%02X", X, NN); return text;
+        case 0xD000: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", X, Y, N); return text;
+        case 0xE000:
+            if(NN == 0x9E) { snprintf(text, sizeof(text), "SKP V%X", X); return text; }
+            if(NN == 0xA1) { snprintf(text, sizeof(text), "SKNP V%X", X); return text; }
+            break;
+        case 0xF000: {
+            const char *format = nullptr;
+            switch(NN) {
+                case 0x07: format = "LD V%X, DT"; break;
+                case 0x0A: format = "LD V%X, K"; break;
+                case 0x15: format = "LD DT, V%X"; break;
+                case 0x18: format = "LD ST, V%X"; break;
+                case 0x1E: format = "ADD I, V%X"; break;
+                case 0x29: format = "LD F, V%X"; break;
+                case 0x33: format = "LD B, V%X"; break;
+                case 0x55: format = "LD [I], V%X"; break;
+                case 0x65: format = "LD V%X, [I]"; break;
+            }
+            if(!format) break;
+            snprintf(text, sizeof(text), format, X);
+            return text;
+        }
+    }
+    snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+    return text;
+}
+
+// Family name of one SUPER-CHIP or XO-CHIP instruction, null for the classic ones
+static const char *extendedFamily(uint16_t opcode, Mode mode) {
+    bool xo = mode == Mode::XoChip;
+    switch(opcode & 0xF000u) {
+        case 0x0000:
+            if((opcode & 0xFFF0u) == 0x00C0u) return "00CN";
+            if(xo && (opcode & 0xFFF0u) == 0x00D0u) return "00DN";
+            if(opcode == 0x00FBu) return "00FB";
+            if(opcode == 0x00FCu) return "00FC";
+            if(opcode == 0x00FDu) return "00FD";
+            if(opcode == 0x00FEu) return "00FE";
+            if(opcode == 0x00FFu) return "00FF";
+            break;
+        case 0x5000:
+            if(xo && (opcode & 0x000Fu) == 0x2) return "5XY2";
+            if(xo && (opcode & 0x000Fu) == 0x3) return "5XY3";
+            break;
+        case 0xF000:
+            if(xo && opcode == 0xF000u) return "F000";
+            if(xo && opcode == 0xF002u) return "F002";
+            if(xo && (opcode & 0x00FFu) == 0x01) return "FN01";
+            if((opcode & 0x00FFu) == 0x30) return "FX30";
+            if(xo && (opcode & 0x00FFu) == 0x3A) return "FX3A";
+            if((opcode & 0x00FFu) == 0x75) return "FX75";
+            if((opcode & 0x00FFu) == 0x85) return "FX85";
+            break;
+    }
+    return nullptr;
+}
+
+// Family name of one instruction, the same table of names as the op_* methods
+const char *opcodeFamily(uint16_t opcode, Mode mode) {
+    if(mode != Mode::Chip8) {
+        if(const char *family = extendedFamily(opcode, mode))
+            return family;
+    }
+    static const char *const ALU[16] = {"8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7",
+                                        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "8XYE", nullptr};
+    switch(opcode & 0xF000u) {
+        case 0x0000:
+            if(opcode == 0x00E0) return "00E0";
+            if(opcode == 0x00EE) return "00EE";
+            return "0NNN";
+        case 0x1000: return "1NNN";
+        case 0x2000: return "2NNN";
+        case 0x3000: return "3XNN";
+        case 0x4000: return "4XNN";
+        case 0x5000: return "5XY0";
+        case 0x6000: return "6XNN";
+        case 0x7000: return "7XNN";
+        case 0x8000: return ALU[opcode & 0x000F] ? ALU[opcode & 0x000F] : "invalid";
+        case 0x9000: return "9XY0";
+        case 0xA000: return "ANNN";
+        case 0xB000: return "BNNN";
+        case 0xC000: return "CXNN";
+        case 0xD000: return "DXYN";
+        case 0xE000:
+            if((opcode & 0x00FF) == 0x9E) return "EX9E";
+            if((opcode & 0x00FF) == 0xA1) return "EXA1";
+            return "invalid";
+        case 0xF000:
+            switch(opcode & 0x00FF) {
+                case 0x07: return "FX07";
+                case 0x0A: return "FX0A";
+                case 0x15: return "FX15";
+                case 0x18: return "FX18";
+                case 0x1E: return "FX1E";
+                case 0x29: return "FX29";
+                case 0x33: return "FX33";
+                case 0x55: return "FX55";
+                case 0x65: return "FX65";
+            }
+    }
+    return "invalid";
+}
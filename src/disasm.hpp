@@ -0,0 +1,15 @@
+#pragma once
+#include "CHIP8.hpp"
+#include <cstdint>
+#include <string>
+using namespace std;
+
+//Mnemonic for one CHIP-8 instruction in the usual Cowgod notation, e.g. "DRW V1, V2, 5", decoded the
+//way the interpreter runs it in mode with quirks (BNNN is "JP VX, XNN" under CHIP-48 and SUPER-CHIP)
+//Words the interpreter does nothing for come back as "DW 0xNNNN"
+//next is the word after the instruction, only read for the address of XO-CHIP F000 NNNN
+string disassemble(uint16_t opcode, Mode mode = Mode::Chip8, Quirks quirks = Quirks::Default, uint16_t next = 0);
+
+//Name of the instruction family in the op_* naming of chip8, e.g. "8XY4" or "00FE", or "invalid"
+//5XYN and 9XYN are named 5XY0 and 9XY0 whatever their low nibble, as they run the same
+const char *opcodeFamily(uint16_t opcode, Mode mode = Mode::Chip8);
@@ -0,0 +1,187 @@
+#include "emuthread.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+// Slot the writer fills next, never read by the render thread until published
+frameSnapshot &frameExchange::writeBuffer() {
+    return slots[back].snapshot;
+}
+
+// Swap the filled slot into the middle, the previous middle slot becomes the new write slot
+// Release publishes the snapshot contents to the reader's acquire in fetch
+void frameExchange::publish() {
+    back = middle.exchange(back | FRESH, memory_order_acq_rel) & INDEX_MASK;
+}
+
+// Take the newest published frame if there is one the reader has not seen yet
+bool frameExchange::fetch() {
+    if(!(middle.load(memory_order_relaxed) & FRESH))
+        return false;
+    front = middle.exchange(front, memory_order_acq_rel) & INDEX_MASK;
+    return true;
+}
+
+// Frame taken by the last successful fetch
+const frameSnapshot &frameExchange::readBuffer() const {
+    return slots[front].snapshot;
+}
+
+// Rewind history holds rewindSeconds of frames, 0 disables it
+// A frame delta averages a few hundred bytes, the ring is sized at one keyframe of the emulator's mode plus
+// 32 KB of deltas per second
+emulationThread::emulationThread(chip8 &emulator, int instructionsPerFrame, int rewindSeconds)
+    : emulator(emulator), instructionsPerFrame(instructionsPerFrame) {
+    if(rewindSeconds > 0) 
+        history.reset(new rewindBuffer(size_t(rewindSeconds) * 60,
+                                       size_t(rewindSeconds) * (chip8::stateSize(emulator.getMode()) + 32768)));
+}
+
+emulationThread::~emulationThread() {
+    stop();
+}
+
+// Record key changes into log, which must have been begun on the loaded emulator
+// Call before start, the log belongs to the emulation thread until stop returns
+void emulationThread::setRecording(inputLog *log) {
+    recording = log;
+}
+
+// Record frame times and opcode counts into stats, call before start
+void emulationThread::setTelemetry(telemetry *stats) {
+    this->stats = stats;
+    emulator.setOpcodeCounters(stats ? stats->opcodeCounters() : nullptr);
+    if(stats)
+        stats->setMode(emulator.getMode());
+}
+
+// Start emulating, onFrame is called on the emulation thread after each published frame
+// The emulator must not be touched by other threads until stop returns
+void emulationThread::start(function<void()> onFrame) {
+    if(running.exchange(true))
+        return;
+    frameReady = move(onFrame);
+    worker = thread(&emulationThread::loop, this);
+}
+
+// Ask the thread to finish its current frame and wait for it
+void emulationThread::stop() {
+    running = false;
+    if(worker.joinable())
+        worker.join();
+}
+
+// Publish the keypad state, called from the input thread
+// Returns its sequence number, frames emulated with this state or a later one carry at least that number
+uint64_t emulationThread::setKeys(const uint8_t keypad[16]) {
+    keys.store(inputLog::keyMask(keypad) | (++keySequence << 16), memory_order_release);
+    return keySequence;
+}
+
+// Step backwards through the history instead of emulating while on is set
+void emulationThread::setRewinding(bool on) {
+    rewinding.store(on, memory_order_relaxed);
+}
+
+// Speed and presentation interval used while turbo is on, call before start
+void emulationThread::setTurboSpeed(int multiple, int frameSkip) {
+    turboSpeed = max(0, multiple);
+    turboSkip = max(0, frameSkip);
+}
+
+// Run at the turbo speed instead of 60 Hz while on is set
+void emulationThread::setTurbo(bool on) {
+    turbo.store(on, memory_order_relaxed);
+}
+
+// Whether turbo is currently requested
+bool emulationThread::turboActive() const {
+    return turbo.load(memory_order_relaxed);
+}
+
+// Make the newest finished frame current, false if nothing new was published
+bool emulationThread::fetchFrame() {
+    return frames.fetch();
+}
+
+// Frame made current by the last successful fetchFrame
+const frameSnapshot &emulationThread::latestFrame() const {
+    return frames.readBuffer();
+}
+
+// Fixed-step frame loop: apply the latest keys, run (or rewind) each due frame, publish a snapshot, sleep
+// In turbo the clock runs faster and only some batches are published
+void emulationThread::loop() {
+    static const chrono::nanoseconds PRESENT_INTERVAL{1000000000 / 60};
+    frameScheduler scheduler;
+    uint64_t frameCount = 0;
+    bool fast = false;
+    auto lastPublish = chrono::steady_clock::now();
+    while(running.load(memory_order_relaxed)) {
+        if(turbo.load(memory_order_relaxed) != fast) {
+            fast = !fast;
+            scheduler.setSpeed(fast ? turboSpeed : 1);
+        }
+        int due = scheduler.framesDue();
+        if(due > 0) {
+            uint64_t keyState = keys.load(memory_order_acquire);
+            uint16_t mask = uint16_t(keyState);
+            uint8_t *keypad = emulator.getKeypad();
+            for(int i = 0; i < 16; i++)
+                keypad[i] = (mask >> i) & 1u;
+            bool back = history && rewinding.load(memory_order_relaxed);
+            if(recording && !back) 
+                recording->record(emulator.getCycles(), mask);
+            for(int i = 0; i < due; i++) {
+                if(back) {
+                    history->stepBack(emulator);
+                    if(recording) 
+                        recording->truncate(emulator.getCycles());
+                    continue;
+                }
+                auto frameStart = stats ? chrono::steady_clock::now() : chrono::steady_clock::time_point{};
+                uint64_t startCycles = emulator.getCycles();
+                emulator.runFrame(instructionsPerFrame);
+                if(history) 
+                    history->capture(emulator);
+                if(stats) 
+                    stats->recordFrame(emulator.getCycles() - startCycles, chrono::steady_clock::now() - frameStart);
+            }
+            frameCount += due;
+            //In turbo only every turboSkip-th frame, or one frame per 60 Hz of wall time, is presented
+            bool present = true;
+            if(fast) {
+                auto now = chrono::steady_clock::now();
+                present = turboSkip > 0 ? frameCount / turboSkip != (frameCount - due) / turboSkip
+                                        : now - lastPublish >= PRESENT_INTERVAL;
+                if(present)
+                    lastPublish = now;
+            }
+            if(present) {
+                frameSnapshot &snapshot = frames.writeBuffer();
+                memcpy(snapshot.screen, emulator.getScreen(), sizeof(snapshot.screen));
+                snapshot.extended = emulator.getMode() != Mode::Chip8;
+                if(snapshot.extended) 
+                    memcpy(snapshot.planes, emulator.getPlanes(), sizeof(snapshot.planes));
+                const uint8_t *pattern = emulator.getAudioPattern();
+                snapshot.hasPattern = pattern != NULL;
+                if(pattern) 
+                    memcpy(snapshot.pattern, pattern, sizeof(snapshot.pattern));
+                snapshot.pitch = emulator.getPitch();
+                memcpy(snapshot.registers, emulator.getRegisters(), sizeof(snapshot.registers));
+                memcpy(snapshot.stack, emulator.getStack(), sizeof(snapshot.stack));
+                snapshot.pc = emulator.getPC();
+                snapshot.sound = emulator.soundActive() && !fast;
+                snapshot.frame = frameCount;
+                snapshot.inputSequence = keyState >> 16;
+                frames.publish();
+                if(frameReady)
+                    frameReady();
+            }
+            if(stats) 
+                stats->exportIfDue();
+        }
+        this_thread::sleep_for(scheduler.timeUntilNextFrame());
+    }
+}
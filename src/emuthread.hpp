@@ -0,0 +1,104 @@
+#pragma once
+#include "CHIP8.hpp"
+#include "inputlog.hpp"
+#include "rewind.hpp"
+#include "telemetry.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+using namespace std;
+
+/* Emulation thread
+ * Runs the 60 Hz frame loop on its own thread so a slow present or vsync stall on the
+ * render thread never delays instruction execution.
+ *
+ * Finished frames are published through a lock-free triple buffer: the emulation thread
+ * always owns one slot to write, the render thread one slot to read, and the third slot
+ * holds the newest finished frame. Neither side ever waits for the other, the reader
+ * simply skips frames it was too slow to see.
+ *
+ * Keypad state comes in the other direction as a 16-bit mask in one atomic word, together with
+ * a sequence number that each snapshot echoes back, so the input thread can tell which frames
+ * were emulated with a given key change.
+ * While rewinding is held, each due frame steps the history back instead of emulating.
+ * An optional input log records every key change at the cycle it reached the emulator.
+ *
+ * Turbo mode runs the frame clock at a multiple of 60 Hz, or uncapped. Every frame still runs
+ * its full instruction budget and timer tick, so games see normal time. Only some frames are
+ * published, either every turboSkip-th frame or one per 60 Hz of wall time, and the beep is
+ * muted while turbo is on.
+ */
+
+//Everything the render thread needs from one emulated frame
+struct frameSnapshot {
+    uint64_t screen[32];
+    uint64_t planes[2][64][2];                  //SUPER-CHIP / XO-CHIP display, copied only when extended is set
+    bool extended;
+    bool hasPattern;                            //XO-CHIP program loaded an audio pattern
+    uint8_t pattern[16];
+    uint8_t pitch;
+    uint8_t registers[16];
+    uint16_t stack[16];
+    uint16_t pc;
+    bool sound;
+    uint64_t frame;                             //Emulated frame number
+    uint64_t inputSequence;                     //Last setKeys call the frame was emulated with
+};
+
+class frameExchange {
+    static const uint8_t INDEX_MASK{0x03};
+    static const uint8_t FRESH{0x04};           //Set when the middle slot holds a frame not yet read
+
+    struct alignas(64) slot {
+        frameSnapshot snapshot;
+    };
+    slot slots[3];
+    alignas(64) atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back{0};                //Owned by the writer
+    alignas(64) uint8_t front{2};               //Owned by the reader
+
+public:
+    frameSnapshot &writeBuffer();
+    void publish();
+    bool fetch();
+    const frameSnapshot &readBuffer() const;
+};
+
+class emulationThread {
+    chip8 &emulator;
+    int instructionsPerFrame;
+    frameExchange frames;
+    atomic<uint64_t> keys{0};               //Key mask in the low 16 bits, setKeys sequence number above
+    uint64_t keySequence{};                 //Owned by the input thread
+    atomic<bool> running{false};
+    atomic<bool> rewinding{false};
+    atomic<bool> turbo{false};
+    int turboSpeed{};                       //Multiple of 60 Hz in turbo, 0 runs uncapped
+    int turboSkip{};                        //Publish every turboSkip-th frame in turbo, 0 publishes at 60 Hz
+    unique_ptr<rewindBuffer> history;       //Null when rewinding is disabled
+    inputLog *recording{};
+    telemetry *stats{};
+    function<void()> frameReady;
+    thread worker;
+
+    void loop();
+
+public:
+    emulationThread(chip8 &emulator, int instructionsPerFrame, int rewindSeconds);
+    ~emulationThread();
+    emulationThread(const emulationThread&) = delete;
+    emulationThread &operator=(const emulationThread&) = delete;
+
+    void setRecording(inputLog *log);
+    void setTelemetry(telemetry *stats);
+    void start(function<void()> onFrame);
+    void stop();
+    uint64_t setKeys(const uint8_t keypad[16]);
+    void setRewinding(bool on);
+    void setTurboSpeed(int multiple, int frameSkip);
+    void setTurbo(bool on);
+    bool turboActive() const;
+    bool fetchFrame();
+    const frameSnapshot &latestFrame() const;
+};
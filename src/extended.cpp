@@ -0,0 +1,353 @@
+#include "CHIP8.hpp"
+#include <cstring>
+using namespace std;
+
+/* SUPER-CHIP and XO-CHIP
+ * The extended modes draw to planes: one 128x64 display per bitplane, each row two 64-bit
+ * words with bit 63 of the first word as the leftmost pixel. Lores programs address 64x32 and
+ * each of their pixels covers 2x2, so the display never changes size. Vertical scrolls move
+ * whole rows, horizontal scrolls are one double-word shift per row, and sprites are XORed in
+ * as whole 128-bit rows.
+ *
+ * SUPER-CHIP clips sprites at the right and bottom edges and in hires sets VF to the number of
+ * sprite rows that collided. XO-CHIP wraps sprites around the edges and sets VF on any collision.
+ */
+
+static const uint16_t LARGE_FONT{0x00A0};          //10 bytes per digit, right after the small font
+
+static const uint8_t largeFont[160] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0
+};
+
+//Every bit of a sprite row doubled, lores sprites are drawn two display pixels wide
+static inline uint32_t doubleBits(uint32_t bits) {
+    uint32_t doubled = 0;
+    for(int i = 0; i < 16; i++) {
+        if((bits >> i) & 1u)
+            doubled |= 3u << (2 * i);
+    }
+    return doubled;
+}
+
+//Place a sprite row of width pixels (at most 32) with its first pixel at column x of a 128 pixel row
+//Pixels past column 127 wrap around to column 0 or are clipped
+static inline void placeRow(uint32_t bits, unsigned width, unsigned x, bool wrap, uint64_t out[2]) {
+    uint64_t aligned = uint64_t(bits) << (64u - width);
+    if(x < 64) {
+        out[0] = aligned >> x;
+        out[1] = x ? aligned << (64u - x) : 0;
+    } else {
+        out[0] = 0;
+        out[1] = aligned >> (x - 64u);
+    }
+    if(wrap && x + width > 128) {
+        unsigned spill = x + width - 128;
+        out[0] |= (uint64_t(bits) & ((1ull << spill) - 1)) << (64u - spill);
+    }
+}
+
+// Switch instruction set, resets the extended display and loads the large font outside classic mode
+// Call before loading the ROM, classic mode leaves memory below 0x200 exactly as initialize() did
+void chip8::setMode(Mode mode) {
+    this->mode = mode;
+    hires = false;
+    planeMask = 1;
+    pitch = 64;
+    patternLoaded = false;
+    memset(planes, 0, sizeof(planes));
+    memset(flags, 0, sizeof(flags));
+    memset(audioPattern, 0, sizeof(audioPattern));
+    if(mode == Mode::Chip8)
+        memset(&memory[LARGE_FONT], 0, sizeof(largeFont));
+    else
+        memcpy(&memory[LARGE_FONT], largeFont, sizeof(largeFont));
+    dirtyRows = 0xFFFFFFFFu;
+    flushCode();
+}
+
+//Clear the selected bitplanes
+void chip8::op_extended00E0() {
+    for(int plane = 0; plane < 2; plane++) {
+        if(planeMask & (1u << plane))
+            memset(planes[plane], 0, sizeof(planes[plane]));
+    }
+    dirtyRows = 0xFFFFFFFFu;
+}
+
+//Scroll the selected planes down N pixels (N lores pixels in lores)
+void chip8::op_00CN() {
+    unsigned rows = (opcode & 0xFu) * (hires ? 1 : 2);
+    for(int plane = 0; plane < 2; plane++) {
+        if(!(planeMask & (1u << plane)))
+            continue;
+        memmove(planes[plane][rows], planes[plane][0], (64 - rows) * sizeof(planes[plane][0]));
+        memset(planes[plane][0], 0, rows * sizeof(planes[plane][0]));
+    }
+    dirtyRows = 0xFFFFFFFFu;
+}
+
+//Scroll the selected planes up N pixels (XO-CHIP)
+void chip8::op_00DN() {
+    unsigned rows = (opcode & 0xFu) * (hires ? 1 : 2);
+    for(int plane = 0; plane < 2; plane++) {
+        if(!(planeMask & (1u << plane)))
+            continue;
+        memmove(planes[plane][0], planes[plane][rows], (64 - rows) * sizeof(planes[plane][0]));
+        memset(planes[plane][64 - rows], 0, rows * sizeof(planes[plane][0]));
+    }
+    dirtyRows = 0xFFFFFFFFu;
+}
+
+//Scroll the selected planes right 4 pixels, one double-word shift per row
+void chip8::op_00FB() {
+    unsigned shift = hires ? 4 : 8;
+    for(int plane = 0; plane < 2; plane++) {
+        if(!(planeMask & (1u << plane)))
+            continue;
+        for(uint64_t *row : planes[plane]) {
+            row[1] = (row[1] >> shift) | (row[0] << (64 - shift));
+            row[0] >>= shift;
+        }
+    }
+    dirtyRows = 0xFFFFFFFFu;
+}
+
+//Scroll the selected planes left 4 pixels
+void chip8::op_00FC() {
+    unsigned shift = hires ? 4 : 8;
+    for(int plane = 0; plane < 2; plane++) {
+        if(!(planeMask & (1u << plane)))
+            continue;
+        for(uint64_t *row : planes[plane]) {
+            row[0] = (row[0] << shift) | (row[1] >> (64 - shift));
+            row[1] <<= shift;
+        }
+    }
+    dirtyRows = 0xFFFFFFFFu;
+}
+
+//Exit the interpreter: stay on this instruction from now on
+void chip8::op_00FD() {
+    pc -= 2;
+}
+
+//Switch to 64x32 lores, the display is cleared
+void chip8::op_00FE() {
+    hires = false;
+    memset(planes, 0, sizeof(planes));
+    dirtyRows = 0xFFFFFFFFu;
+}
+
+//Switch to 128x64 hires, the display is cleared
+void chip8::op_00FF() {
+    hires = true;
+    memset(planes, 0, sizeof(planes));
+    dirtyRows = 0xFFFFFFFFu;
+}
+
+//Store registers VX to VY (in either order) at I, I is unchanged
+void chip8::op_5XY2() {
+    unsigned X = (opcode & 0x0F00u) >> 8u, Y = (opcode & 0x00F0u) >> 4u;
+    int step = X <= Y ? 1 : -1;
+    for(unsigned i = 0, V = X; ; i++, V += step) {
+        memory[(indreg + i) & 0xFFFFu] = registers[V];
+        if(V == Y)
+            break;
+    }
+}
+
+//Load registers VX to VY (in either order) from I, I is unchanged
+void chip8::op_5XY3() {
+    unsigned X = (opcode & 0x0F00u) >> 8u, Y = (opcode & 0x00F0u) >> 4u;
+    int step = X <= Y ? 1 : -1;
+    for(unsigned i = 0, V = X; ; i++, V += step) {
+        registers[V] = memory[(indreg + i) & 0xFFFFu];
+        if(V == Y)
+            break;
+    }
+}
+
+//Load I with the 16-bit address in the following word
+void chip8::op_F000() {
+    indreg = (memory[pc] << 8u) | memory[uint16_t(pc + 1)];
+    pc += 2;
+}
+
+//Select the bitplanes drawn, cleared and scrolled by later instructions
+void chip8::op_FN01() {
+    planeMask = (opcode & 0x0F00u) >> 8u & 3u;
+}
+
+//Load the 16-byte audio pattern from I
+void chip8::op_F002() {
+    for(int i = 0; i < 16; i++)
+        audioPattern[i] = memory[(indreg + i) & 0xFFFFu];
+    patternLoaded = true;
+}
+
+//Set I to the large font digit for the low nibble of VX
+void chip8::op_FX30() {
+    uint8_t VX = registers[(opcode & 0x0F00u) >> 8u];
+    indreg = LARGE_FONT + (VX & 0xFu) * 10;
+}
+
+//Set the audio pattern playback pitch to VX
+void chip8::op_FX3A() {
+    pitch = registers[(opcode & 0x0F00u) >> 8u];
+}
+
+//Save V0 to VX in the user flags (V0 to V7 on SUPER-CHIP)
+void chip8::op_FX75() {
+    unsigned X = (opcode & 0x0F00u) >> 8u;
+    if(mode == Mode::SuperChip)
+        X &= 7u;
+    memcpy(flags, registers, X + 1);
+}
+
+//Load V0 to VX from the user flags (V0 to V7 on SUPER-CHIP)
+void chip8::op_FX85() {
+    unsigned X = (opcode & 0x0F00u) >> 8u;
+    if(mode == Mode::SuperChip)
+        X &= 7u;
+    memcpy(registers, flags, X + 1);
+}
+
+//Draw an 8xN sprite, or a 16x16 sprite for N = 0, at VX, VY into each selected plane
+//With two planes selected the sprite data holds the first plane's rows followed by the second's
+//wrap comes from the quirks profile, as for the classic op_DXYN
+void chip8::op_extendedDXYN(bool wrap) {
+    unsigned scale = hires ? 1 : 2;
+    unsigned N = opcode & 0xFu;
+    unsigned height = N ? N : 16;
+    unsigned width = N ? 8 : 16;
+    unsigned x = (registers[(opcode & 0x0F00u) >> 8u] % (128 / scale)) * scale;
+    unsigned y = (registers[(opcode & 0x00F0u) >> 4u] % (64 / scale)) * scale;
+    unsigned collisions = 0;
+    uint16_t address = indreg;
+
+    for(int plane = 0; plane < 2; plane++) {
+        if(!(planeMask & (1u << plane)))
+            continue;
+        for(unsigned i = 0; i < height; i++, address += width / 8) {
+            uint32_t bits = memory[address];
+            if(width == 16)
+                bits = (bits << 8u) | memory[uint16_t(address + 1)];
+            uint64_t sprite[2];
+            if(scale == 2)
+                placeRow(doubleBits(bits), width * 2, x, wrap, sprite);
+            else
+                placeRow(bits, width, x, wrap, sprite);
+
+            bool hit = false;
+            for(unsigned r = 0; r < scale; r++) {
+                unsigned row = y + i * scale + r;
+                if(row >= 64 && !wrap)
+                    break;
+                uint64_t *line = planes[plane][row & 63u];
+                hit |= ((line[0] & sprite[0]) | (line[1] & sprite[1])) != 0;
+                line[0] ^= sprite[0];
+                line[1] ^= sprite[1];
+                if(sprite[0] | sprite[1])
+                    dirtyRows |= 1u << ((row & 63u) >> 1);
+            }
+            collisions += hit;
+        }
+    }
+    registers[0xF] = (mode == Mode::SuperChip && hires) ? collisions : collisions != 0;
+}
+
+// An XO-CHIP skip whose target is F000 NNNN skips all four bytes of it
+// next is the address of the instruction after the skip
+void chip8::skipLongInstruction(uint16_t next) {
+    if(pc == uint16_t(next + 2) && memory[next] == 0xF0 && memory[uint16_t(next + 1)] == 0x00)
+        pc += 2;
+}
+
+// Decode and execute an opcode that differs in the extended modes, false if the classic decoder handles it
+bool chip8::decodeExtended(uint16_t opcode) {
+    bool xo = mode == Mode::XoChip;
+    uint16_t next = pc;
+    switch(opcode & 0xF000u) {
+        case 0x0000:
+            if((opcode & 0xFFF0u) == 0x00C0u) op_00CN();
+            else if(xo && (opcode & 0xFFF0u) == 0x00D0u) op_00DN();
+            else if(opcode == 0x00E0u) op_extended00E0();
+            else if(opcode == 0x00FBu) op_00FB();
+            else if(opcode == 0x00FCu) op_00FC();
+            else if(opcode == 0x00FDu) op_00FD();
+            else if(opcode == 0x00FEu) op_00FE();
+            else if(opcode == 0x00FFu) op_00FF();
+            else return false;
+            return true;
+        case 0xF000:
+            if(xo && opcode == 0xF000u) op_F000();
+            else if(xo && opcode == 0xF002u) op_F002();
+            else if(xo && (opcode & 0x00FFu) == 0x01u) op_FN01();
+            else if((opcode & 0x00FFu) == 0x30u) op_FX30();
+            else if(xo && (opcode & 0x00FFu) == 0x3Au) op_FX3A();
+            else if((opcode & 0x00FFu) == 0x75u) op_FX75();
+            else if((opcode & 0x00FFu) == 0x85u) op_FX85();
+            else return false;
+            return true;
+    }
+    if(!xo)
+        return false;
+    switch(opcode & 0xF000u) {
+        case 0x3000: op_3XNN(); break;
+        case 0x4000: op_4XNN(); break;
+        case 0x5000:
+            if((opcode & 0xFu) == 0x2u) op_5XY2();
+            else if((opcode & 0xFu) == 0x3u) op_5XY3();
+            else op_5XY0();
+            break;
+        case 0x9000: op_9XY0(); break;
+        case 0xE000:
+            if((opcode & 0x00FFu) == 0x9Eu) op_EX9E();
+            else if((opcode & 0x00FFu) == 0xA1u) op_EXA1();
+            break;
+        default:
+            return false;
+    }
+    skipLongInstruction(next);
+    return true;
+}
+
+// Extended display, [plane][row][half], only drawn to outside classic mode
+const uint64_t (*chip8::getPlanes() const)[64][2] {
+    return planes;
+}
+
+// Instruction set selected with setMode
+Mode chip8::getMode() const {
+    return mode;
+}
+
+// Whether an extended-mode program switched to 128x64
+bool chip8::isHires() const {
+    return hires;
+}
+
+// XO-CHIP audio pattern (16 bytes, most significant bit first), null until F002 loads one
+const uint8_t *chip8::getAudioPattern() const {
+    return (mode == Mode::XoChip && patternLoaded) ? audioPattern : nullptr;
+}
+
+// XO-CHIP playback pitch: the pattern plays at 4000 * 2^((pitch - 64) / 48) bits per second
+uint8_t chip8::getPitch() const {
+    return pitch;
+}
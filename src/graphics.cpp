@@ -4,9 +4,23 @@
 #include <iostream>
 #include <cmath>
 #include <algorithm>
-#include <iomanip>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <string>
 using namespace std;
 
+//Default keypad layout, the 4x4 block under 1234 on a QWERTY keyboard
+static const struct {
+    SDL_Scancode scancode;
+    uint8_t key;
+} DEFAULT_KEYS[16] = {
+    {SDL_SCANCODE_1, 0x1}, {SDL_SCANCODE_2, 0x2}, {SDL_SCANCODE_3, 0x3}, {SDL_SCANCODE_4, 0xC},
+    {SDL_SCANCODE_Q, 0x4}, {SDL_SCANCODE_W, 0x5}, {SDL_SCANCODE_E, 0x6}, {SDL_SCANCODE_R, 0xD},
+    {SDL_SCANCODE_A, 0x7}, {SDL_SCANCODE_S, 0x8}, {SDL_SCANCODE_D, 0x9}, {SDL_SCANCODE_F, 0xE},
+    {SDL_SCANCODE_Z, 0xA}, {SDL_SCANCODE_X, 0x0}, {SDL_SCANCODE_C, 0xB}, {SDL_SCANCODE_V, 0xF},
+};
+
 // Graphics class constructor 
 // Intializes: gamePosition, SDL audio and video subsystems, SDL texture formatting, SDL audiostreams
 // Setup window size and game position and stack visualizer position
@@ -19,6 +33,13 @@ Graphics::Graphics() {
     debugWidth = WINDOW_WIDTH/7;
     debugXpos = gamePosition.x + gamePosition.w + WINDOW_WIDTH/20; 
     debugYpos = gamePosition.y;
+    for(int i = 0; i < WAVE_LENGTH; i++) {
+        float t = (float)i / SAMPLING_RATE;
+        wavetable[i] = 0.5f * (sinf(2 * M_PI * FREQUENCY1 * t) + sinf(2 * M_PI * FREQUENCY2 * t)); 
+    }
+    fill(keyMap, keyMap + SDL_SCANCODE_COUNT, NO_KEY);
+    for(const auto &binding : DEFAULT_KEYS)
+        keyMap[binding.scancode] = binding.key;
 
     if(!TTF_Init()) {
         cerr << "Could not initialize TTF! SDL_ERROR: " << SDL_GetError() << endl;
@@ -33,34 +54,90 @@ Graphics::Graphics() {
         cerr << "Could not create window and renderer! SDL_ERROR: " << SDL_GetError() << endl;
     else {
         screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
-        stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, NULL, NULL); 
+        extendedScreen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 128, 64);
+        stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, audioCallback, this); 
         if(screen == NULL)
             cerr << "Could not create texture! SDL_ERROR: " << SDL_GetError() << endl;
         if(!stream) 
             cerr << "Could not open audio stream! SDL_ERROR: " << SDL_GetError() << endl;
         SDL_SetTextureScaleMode(screen, SDL_SCALEMODE_NEAREST);
+        SDL_SetTextureScaleMode(extendedScreen, SDL_SCALEMODE_NEAREST);
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_SetTextureBlendMode(screen, SDL_BLENDMODE_NONE);
         if(!SDL_ResumeAudioStreamDevice(stream)) {
             cerr << "Audio stream failed! SDL_ERROR: " << SDL_GetError() << endl; 
         }
+        SDL_AudioSpec deviceSpec;
+        if(stream && !SDL_GetAudioDeviceFormat(SDL_GetAudioStreamDevice(stream), &deviceSpec, &deviceFrames)) 
+            deviceFrames = 0;
+        buildGlyphAtlas();
+    }
+}
+
+// Render the overlay character set once into the glyph atlas texture
+// Place one quad per character cell of every overlay line, lines are filled in by layoutLine
+void Graphics::buildGlyphAtlas() {
+    SDL_Color color{255,255,255,255};
+    SDL_Surface *segment = font ? TTF_RenderText_Blended(font, ATLAS_GLYPHS, ATLAS_SIZE, color) : NULL;
+    if(!segment) { 
+        cerr << "Could not render text! SDL_ERROR: " << SDL_GetError() << endl; 
+        return; 
+    }
+    glyphAtlas = SDL_CreateTextureFromSurface(renderer, segment);
+    for(int i = 0; i <= ATLAS_SIZE; i++) {
+        int w = 0;
+        TTF_GetStringSize(font, ATLAS_GLYPHS, i, &w, NULL);
+        glyphU[i] = (float)w / segment->w;
+        if(i < ATLAS_SIZE) 
+            glyphIndex[(uint8_t)ATLAS_GLYPHS[i]] = i;
+    }
+    SDL_DestroySurface(segment); 
+
+    float cellWidth = debugWidth / 8;
+    for(int line = 0; line < OVERLAY_LINES; line++) {
+        float x = (line >= 16 && line < 32) ? debugXpos + debugWidth + WINDOW_WIDTH/20 : debugXpos;
+        float y = debugYpos + debugHeight * (line % 16 + (line == 32 ? 16 : 0));
+        for(int k = 0; k < LINE_GLYPHS; k++) {
+            int glyph = line * LINE_GLYPHS + k;
+            SDL_Vertex *quad = &overlayVertices[glyph * 4];
+            float left = x + cellWidth * k;
+            quad[0].position = SDL_FPoint{left, y};
+            quad[1].position = SDL_FPoint{left + cellWidth, y};
+            quad[2].position = SDL_FPoint{left + cellWidth, y + debugHeight};
+            quad[3].position = SDL_FPoint{left, y + debugHeight};
+            for(int v = 0; v < 4; v++) 
+                quad[v].color = SDL_FColor{1.0f, 1.0f, 1.0f, 1.0f};
+
+            int *index = &overlayIndices[glyph * 6];
+            index[0] = glyph * 4; index[1] = glyph * 4 + 1; index[2] = glyph * 4 + 2;
+            index[3] = glyph * 4; index[4] = glyph * 4 + 2; index[5] = glyph * 4 + 3;
+        }
+    }
+}
+
+// Point the quads of one overlay line at the atlas glyphs for its text
+void Graphics::layoutLine(int line, const char text[LINE_GLYPHS]) {
+    for(int k = 0; k < LINE_GLYPHS; k++) {
+        int glyph = glyphIndex[(uint8_t)text[k] & 0x7F];
+        SDL_Vertex *quad = &overlayVertices[(line * LINE_GLYPHS + k) * 4];
+        quad[0].tex_coord = SDL_FPoint{glyphU[glyph], 0.0f};
+        quad[1].tex_coord = SDL_FPoint{glyphU[glyph + 1], 0.0f};
+        quad[2].tex_coord = SDL_FPoint{glyphU[glyph + 1], 1.0f};
+        quad[3].tex_coord = SDL_FPoint{glyphU[glyph], 1.0f};
     }
 }
 
 // Graphics class destructer helper method
 // Destroys: window, renderer, textures, audiostream, SDL overhead
-// Destroys: the stack textures (16 for registers 16 for stack)
+// Destroys: the debug overlay glyph atlas
 void Graphics::cleanUp() {
     SDL_DestroyWindow(window);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyTexture(screen);
+    SDL_DestroyTexture(extendedScreen);
+    SDL_DestroyTexture(glyphAtlas);
     TTF_CloseFont(font);
     SDL_DestroyAudioStream(stream); 
-    for(int i = 0; i < 16; i++) {
-        regTextures[i].destroy();
-        stackTextures[i].destroy();
-    }
-    pcTexture.destroy();
     TTF_Quit();
     SDL_Quit(); 
 }
@@ -80,10 +157,13 @@ SDL_Renderer* Graphics::getRenderer() {
     return renderer; 
 }
 
-// Access the pixels inside the game display texture
-uint8_t* Graphics::accessPixels() {
-    if(!SDL_LockTexture(screen, NULL, &pixels, &pitch)) 
+// Access the pixels of rows [firstRow, firstRow + rowCount) inside the game display texture
+uint8_t* Graphics::accessPixels(int firstRow, int rowCount) {
+    SDL_Rect rows{0, firstRow, 64, rowCount};
+    if(!SDL_LockTexture(screen, &rows, &pixels, &pitch)) {
         cerr << "Could not lock texture! STD_ERROR: " << SDL_GetError() << endl;
+        return NULL;
+    }
     framebuffer = (uint8_t *) pixels; 
     return framebuffer;
 }
@@ -93,154 +173,269 @@ void Graphics::updatePixels() {
     SDL_UnlockTexture(screen);
 }
 
-// Display updates to the computer screen
-void Graphics::updateScreen(uint8_t registers[16], uint16_t stack[16], uint16_t pc) {
+// Convert the changed rows of the CHIP-8 display into texture pixels
+// Each run of consecutive dirty rows is uploaded with a single lock of just those rows
+// Rows that are still fading out under persistence are redrawn even when their pixels did not change
+void Graphics::updateDisplay(const uint64_t *chip8Screen, uint32_t dirtyRows) {
+    dirtyRows |= pipeline.fadingRows();
+    int row = 0;
+    while(row < 32) {
+        if(!((dirtyRows >> row) & 1u)) {
+            row++;
+            continue;
+        }
+        int first = row;
+        while(row < 32 && ((dirtyRows >> row) & 1u)) 
+            row++;
+        if(!accessPixels(first, row - first))
+            continue;
+        pipeline.expandRows(chip8Screen, first, row - first, framebuffer, pitch);
+        updatePixels();
+        screenChanged = true;
+    }
+    if(extendedActive) {
+        extendedActive = false;
+        screenChanged = true;
+    }
+}
+
+// Convert the changed rows of the 128x64 extended display into texture pixels
+// Each pixel's colour comes from its bits in the two planes: off, plane 1, plane 2 or both
+void Graphics::updateExtendedDisplay(const uint64_t planes[2][64][2], uint64_t dirtyRows) {
+    if(!extendedScreen) 
+        return;
+    if(!extendedActive) {
+        extendedActive = true;
+        dirtyRows = ~0ull;
+    }
+    dirtyRows |= pipeline.fadingPlaneRows();
+    int row = 0;
+    while(row < 64) {
+        if(!((dirtyRows >> row) & 1u)) {
+            row++;
+            continue;
+        }
+        int first = row;
+        while(row < 64 && ((dirtyRows >> row) & 1u)) 
+            row++;
+        SDL_Rect rows{0, first, 128, row - first};
+        void *texels;
+        int texturePitch;
+        if(!SDL_LockTexture(extendedScreen, &rows, &texels, &texturePitch)) {
+            cerr << "Could not lock texture! STD_ERROR: " << SDL_GetError() << endl;
+            continue;
+        }
+        pipeline.expandPlaneRows(planes, first, row - first, (uint8_t *)texels, texturePitch);
+        SDL_UnlockTexture(extendedScreen);
+        screenChanged = true;
+    }
+}
+
+// Select the display colours, before the first frame is drawn
+void Graphics::setPalette(const palette &colours) {
+    pipeline.setPalette(colours);
+}
+
+// Let unlit pixels keep this fraction of their brightness each frame, 0 turns persistence off
+void Graphics::setPersistence(float kept) {
+    pipeline.setPersistence(kept);
+}
+
+// Display updates to the computer screen, called once per display refresh
+// Nothing is presented when neither the game texture nor the debug values changed, returns whether it presented
+bool Graphics::updateScreen(const uint8_t registers[16], const uint16_t stack[16], uint16_t pc) {
+    bool hardwareChanged = memcmp(registerLines, registers, sizeof(registerLines)) != 0 
+        || memcmp(stackLines, stack, sizeof(stackLines)) != 0 || this->pc != pc;
+    if(!screenChanged && !hardwareChanged) 
+        return false;
+
     SDL_RenderClear(renderer);
     updateHardware(registers, stack, pc);
-    SDL_RenderTexture(renderer, screen, NULL, &gamePosition);
+    SDL_RenderTexture(renderer, extendedActive ? extendedScreen : screen, NULL, &gamePosition);
     SDL_RenderPresent(renderer);
+    screenChanged = false;
+    return true;
 }
 
-// Generate the audio beep sound buffer
-void Graphics::generateAudio(bool on) {
-    if(on) {
-        for(int i = 0; i < BUFF_LENGTH; i++) {
-            audio_buf[i] = 0.5f * (sinf(2 * M_PI * time1) + sinf(2 * M_PI * time2)); 
-            time1 += FREQUENCY1/(float)SAMPLING_RATE; 
-            time2 += FREQUENCY2/(float)SAMPLING_RATE;
-
-            if(time1 >= 1.0) {
-                time1 -= 1.0;
-            }
-            if(time2 >= 1.0) {
-                time2 -= 1.0;
-            }
-        } 
-    } 
+// Wait for the display's vertical blank when presenting
+void Graphics::setVSync(bool on) {
+    if(!SDL_SetRenderVSync(renderer, on ? 1 : 0)) 
+        cerr << "Could not set vsync! SDL_ERROR: " << SDL_GetError() << endl;
+}
+
+// Force the next updateScreen to present, e.g. after the window was exposed
+void Graphics::invalidate() {
+    screenChanged = true;
+}
+
+// Audio stream callback, runs on SDL's audio thread whenever the device needs more samples
+// Supplies exactly the requested amount, the beep or silence, so nothing queues up ahead of the device
+void SDLCALL Graphics::audioCallback(void *userdata, SDL_AudioStream *stream, int additional, int) {
+    Graphics *graphics = static_cast<Graphics*>(userdata);
+    telemetry *stats = graphics->stats.load(memory_order_acquire);
+    auto start = stats ? chrono::steady_clock::now() : chrono::steady_clock::time_point{};
+    float chunk[512];
+    int samples = additional / (int)sizeof(float);
+
+    while(samples > 0) {
+        int count = min(samples, 512);
+        graphics->generateSamples(chunk, count);
+        SDL_PutAudioStreamData(stream, chunk, count * sizeof(float));
+        samples -= count;
+    }
+    if(stats) 
+        stats->recordAudio(chrono::steady_clock::now() - start);
+}
+
+// Time audio callbacks into stats, null stops
+void Graphics::setTelemetry(telemetry *stats) {
+    this->stats.store(stats, memory_order_release);
 }
 
-// Send audio beep buffer to the output stream
-void Graphics::playSound(bool on) {
-    if(on) {
-        if(!SDL_PutAudioStreamData(stream, audio_buf, LENGTH)) {
-            cerr << "Could not load data into audio stream! SDL_ERROR: " << SDL_GetError() << endl; 
-        } 
+// Fill out with the next count samples: the wavetable (or the XO-CHIP pattern) while beeping, silence otherwise
+void Graphics::generateSamples(float *out, int count) {
+    if(beeping.load(memory_order_relaxed) && patternActive.load(memory_order_relaxed)) {
+        uint64_t bits[2] = {patternBits[0].load(memory_order_relaxed), patternBits[1].load(memory_order_relaxed)};
+        uint32_t step = patternStep.load(memory_order_relaxed);
+        for(int i = 0; i < count; i++) {
+            unsigned bit = (patternPhase >> 16) & 127u;
+            out[i] = ((bits[bit >> 6] >> (63 - (bit & 63))) & 1u) ? 0.25f : -0.25f;
+            patternPhase += step;
+        }
+    } else if(beeping.load(memory_order_relaxed)) {
+        for(int i = 0; i < count; i++) {
+            out[i] = wavetable[wavePosition];
+            if(++wavePosition == WAVE_LENGTH) 
+                wavePosition = 0;
+        }
     } else {
-        if(!SDL_ClearAudioStream(stream)) {
-            cerr << "Could not clear audio stream! SDL_ERROR: " << SDL_GetError() << endl;
+        fill(out, out + count, 0.0f);
+    }
+}
+
+// Play an XO-CHIP audio pattern (16 bytes, first sample in the top bit) instead of the beep, null restores the beep
+// The pattern plays at 4000 * 2^((pitch - 64) / 48) samples per second
+void Graphics::setAudioPattern(const uint8_t *pattern, uint8_t pitch) {
+    if(!pattern) {
+        patternActive.store(false, memory_order_relaxed);
+        return;
+    }
+    uint64_t bits[2] = {};
+    for(int i = 0; i < 16; i++) 
+        bits[i >> 3] |= uint64_t(pattern[i]) << (56 - 8 * (i & 7));
+    double rate = 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+    patternBits[0].store(bits[0], memory_order_relaxed);
+    patternBits[1].store(bits[1], memory_order_relaxed);
+    patternStep.store(uint32_t(rate / SAMPLING_RATE * 65536.0), memory_order_relaxed);
+    patternActive.store(true, memory_order_relaxed);
+}
+
+// Start or stop the beep, called when the sound timer starts or stops running
+void Graphics::setBeep(bool on) {
+    beeping.store(on, memory_order_relaxed);
+}
+
+// Audio queued between the emulator and the speaker in milliseconds: stream backlog plus the device buffer
+float Graphics::audioLatencyMs() {
+    if(!stream) 
+        return 0;
+    int queuedFrames = SDL_GetAudioStreamQueued(stream) / (int)sizeof(float);
+    return (queuedFrames + deviceFrames) * 1000.0f / SAMPLING_RATE;
+}
+
+// Replace the keypad mapping with the one in a key map file
+// One "<scancode name> <hex key>" pair per line, names as SDL_GetScancodeName spells them ("W", "Up", "Keypad 5")
+// '#' starts a comment; a key may be bound to several scancodes. The mapping is unchanged if the file is invalid
+bool Graphics::loadKeyMap(const char *path) {
+    ifstream input(path);
+    if(!input) {
+        cerr << "Could not open key map " << path << "!" << endl;
+        return false;
+    }
+    uint8_t loaded[SDL_SCANCODE_COUNT];
+    fill(loaded, loaded + SDL_SCANCODE_COUNT, NO_KEY);
+    string line;
+    for(int lineNumber = 1; getline(input, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        size_t last = line.find_last_not_of(" \t\r");
+        if(last == string::npos) 
+            continue;
+        //The key is the last field, the scancode name before it may contain spaces
+        size_t first = line.find_first_not_of(" \t");
+        size_t split = line.find_last_of(" \t", last);
+        string name, key;
+        if(split != string::npos && split > first) {
+            name = line.substr(first, line.find_last_not_of(" \t", split) + 1 - first);
+            key = line.substr(split + 1, last - split);
         }
+        SDL_Scancode scancode = name.empty() ? SDL_SCANCODE_UNKNOWN : SDL_GetScancodeFromName(name.c_str());
+        if(scancode == SDL_SCANCODE_UNKNOWN || key.size() != 1 || !isxdigit((unsigned char)key[0])) {
+            cerr << path << ":" << lineNumber << ": expected <scancode name> <hex key 0-F>" << endl;
+            return false;
+        }
+        loaded[scancode] = uint8_t(stoi(key, nullptr, 16));
     }
+    memcpy(keyMap, loaded, sizeof(keyMap));
+    return true;
 }
 
 // Input buffer for input keys 
-// Set one key to one upon keypress down
-// Set key to zero if released or another key pressed
-void Graphics::inputBuffer(uint8_t *keyBuff, SDL_Event keyEvent) {
-    bool validKey = false;
-    int keyIndex = 0; 
-        if(keyEvent.type == SDL_EVENT_KEY_DOWN) {
-            switch(keyEvent.key.scancode) {
-                case SDL_SCANCODE_1: validKey = true; keyIndex = 1; break;
-                case SDL_SCANCODE_2: validKey = true; keyIndex = 2; break;
-                case SDL_SCANCODE_3: validKey = true; keyIndex = 3; break;
-                case SDL_SCANCODE_4: validKey = true; keyIndex = 0xC; break;
-                case SDL_SCANCODE_Q: validKey = true; keyIndex = 4; break;
-                case SDL_SCANCODE_W: validKey = true; keyIndex = 5; break;
-                case SDL_SCANCODE_E: validKey = true; keyIndex = 6; break;
-                case SDL_SCANCODE_R: validKey = true; keyIndex = 0xD; break;
-                case SDL_SCANCODE_A: validKey = true; keyIndex = 7; break;
-                case SDL_SCANCODE_S: validKey = true; keyIndex = 8; break;
-                case SDL_SCANCODE_D: validKey = true; keyIndex = 9; break;
-                case SDL_SCANCODE_F: validKey = true; keyIndex = 0xE; break;
-                case SDL_SCANCODE_Z: validKey = true; keyIndex = 0xA; break;
-                case SDL_SCANCODE_X: validKey = true; keyIndex = 0x0; break;
-                case SDL_SCANCODE_C: validKey = true; keyIndex = 0xB; break;
-                case SDL_SCANCODE_V: validKey = true; keyIndex = 0xF; break;
-            }
-
-            if(validKey) {
-                fill(keyBuff, keyBuff + 16, 0);
-                keyBuff[keyIndex] = 1; 
-            }
-            validKey = false;
-        } else if(keyEvent.type == SDL_EVENT_KEY_UP) {
-            switch(keyEvent.key.scancode) {
-                case SDL_SCANCODE_1: keyBuff[1] = 0; break;
-                case SDL_SCANCODE_2: keyBuff[2] = 0; break;
-                case SDL_SCANCODE_3: keyBuff[3] = 0; break;
-                case SDL_SCANCODE_4: keyBuff[0xC] = 0; break;
-                case SDL_SCANCODE_Q: keyBuff[4] = 0; break;
-                case SDL_SCANCODE_W: keyBuff[5] = 0; break;
-                case SDL_SCANCODE_E: keyBuff[6] = 0; break;
-                case SDL_SCANCODE_R: keyBuff[0xD] = 0; break;
-                case SDL_SCANCODE_A: keyBuff[7] = 0; break;
-                case SDL_SCANCODE_S: keyBuff[8] = 0; break;
-                case SDL_SCANCODE_D: keyBuff[9] = 0; break;
-                case SDL_SCANCODE_F: keyBuff[0xE] = 0; break;
-                case SDL_SCANCODE_Z: keyBuff[0xA] = 0; break;
-                case SDL_SCANCODE_X: keyBuff[0x0] = 0; break;
-                case SDL_SCANCODE_C: keyBuff[0xB] = 0; break;
-                case SDL_SCANCODE_V: keyBuff[0xF] = 0; break;
-            }
-        }
+// Look the scancode up in the key map, presses set the key and releases clear it
+// Several keys can be held at once, returns true when a CHIP-8 key changed state
+bool Graphics::inputBuffer(uint8_t *keyBuff, SDL_Event keyEvent) {
+    if(keyEvent.type != SDL_EVENT_KEY_DOWN && keyEvent.type != SDL_EVENT_KEY_UP) 
+        return false;
+    if(keyEvent.key.scancode < 0 || keyEvent.key.scancode >= SDL_SCANCODE_COUNT) 
+        return false;
+    uint8_t key = keyMap[keyEvent.key.scancode];
+    uint8_t state = keyEvent.type == SDL_EVENT_KEY_DOWN;
+    if(key == NO_KEY || keyBuff[key] == state) 
+        return false;
+    keyBuff[key] = state;
+    return true;
 }
 
 // Debug methods  
 // Update register values in graphics class
-// Create textures for the stack text and register text
-void Graphics::updateHardware(uint8_t registers[16], uint16_t stack[16], uint16_t pc) {
-    this->pc = pc;
-    SDL_Surface *segment; 
-    SDL_Color color{255,255,255,255};
-    stringstream ss; 
-    string text; 
+// Re-layout only the register, stack and PC lines whose value changed, then draw all lines from the atlas
+// Without an atlas (no font) nothing is drawn, but the values are still kept so updateScreen sees them as shown
+void Graphics::updateHardware(const uint8_t registers[16], const uint16_t stack[16], uint16_t pc) {
+    static const char HEX[] = "0123456789ABCDEF";
+    if(!glyphAtlas) {
+        memcpy(registerLines, registers, sizeof(registerLines));
+        memcpy(stackLines, stack, sizeof(stackLines));
+        this->pc = pc;
+        return;
+    }
 
     for(int i = 0; i < 16; i++) {
-        registerLines[i] = registers[i];
-        stackLines[i] = stack[i]; 
-
-        ss.str("");
-        ss.clear();
-        ss << "V" << std::hex << std::uppercase << i 
-            << ": 0x" << std::setw(2) << std::setfill('0') << static_cast<int>(registers[i]);
-        text = ss.str();
-        segment = TTF_RenderText_Blended(font, text.c_str(), 0, color);
-
-        if(!segment) { 
-            cerr << "Could not render text! SDL_ERROR: " << SDL_GetError() << endl; 
-            return; 
+        if(!overlayValid || registerLines[i] != registers[i]) {
+            registerLines[i] = registers[i];
+            char text[LINE_GLYPHS] = {'V', HEX[i], ':', ' ', '0', 'x', HEX[registers[i] >> 4], HEX[registers[i] & 0xF], ' '};
+            layoutLine(i, text);
         }
-
-        regTextures[i].destroy();
-        regTextures[i].outLine = SDL_CreateTextureFromSurface(renderer, segment);
-        SDL_DestroySurface(segment); 
-        regTextures[i].textPos.x = debugXpos; 
-        regTextures[i].textPos.y = debugYpos + debugHeight * i; 
-        regTextures[i].textPos.w = debugWidth;
-        regTextures[i].textPos.h = debugHeight;
-        SDL_RenderTexture(renderer, regTextures[i].outLine, NULL, &regTextures[i].textPos);
-
-        ss.str("");
-        ss.clear();
-        ss << std::dec << i + 1 << ": 0x" << std::hex 
-            << std::uppercase << std::hex << std::setw(3) << std::setfill('0') << stack[i];
-        text = ss.str();
-        segment = TTF_RenderText_Blended(font, text.c_str(), 0, color);
-
-        if(!segment) { 
-            cerr << "Could not render text! SDL_ERROR: " << SDL_GetError() << endl; 
-            return; 
+        if(!overlayValid || stackLines[i] != stack[i]) {
+            stackLines[i] = stack[i];
+            char text[LINE_GLYPHS];
+            int n = 0;
+            if(i + 1 >= 10) 
+                text[n++] = '1';
+            text[n++] = HEX[(i + 1) % 10];
+            text[n++] = ':'; text[n++] = ' '; text[n++] = '0'; text[n++] = 'x';
+            text[n++] = HEX[(stack[i] >> 8) & 0xF]; 
+            text[n++] = HEX[(stack[i] >> 4) & 0xF]; 
+            text[n++] = HEX[stack[i] & 0xF];
+            while(n < LINE_GLYPHS) 
+                text[n++] = ' ';
+            layoutLine(16 + i, text);
         }
-
-        stackTextures[i].destroy();
-        stackTextures[i].outLine = SDL_CreateTextureFromSurface(renderer, segment);
-        SDL_DestroySurface(segment); 
-        stackTextures[i].textPos.x = debugXpos + debugWidth + WINDOW_WIDTH/20; 
-        stackTextures[i].textPos.y = debugYpos + debugHeight * i; 
-        stackTextures[i].textPos.w = debugWidth;
-        stackTextures[i].textPos.h = debugHeight;
-        SDL_RenderTexture(renderer, stackTextures[i].outLine, NULL, &stackTextures[i].textPos);
     }
-}
-
+    if(!overlayValid || this->pc != pc) {
+        this->pc = pc;
+        char text[LINE_GLYPHS] = {'P', 'C', ':', ' ', '0', 'x', HEX[(pc >> 8) & 0xF], HEX[(pc >> 4) & 0xF], HEX[pc & 0xF]};
+        layoutLine(32, text);
+    }
+    overlayValid = true;
 
+    SDL_RenderGeometry(renderer, glyphAtlas, overlayVertices, OVERLAY_GLYPHS * 4, overlayIndices, OVERLAY_GLYPHS * 6);
+}
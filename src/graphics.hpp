@@ -1,31 +1,31 @@
+#pragma once
 #include <SDL3/SDL.h>
 #include <SDL3_ttf/SDL_ttf.h>
-#include <string>
+#include <atomic>
+#include "telemetry.hpp"
+#include "pixels.hpp"
+using namespace std;
 
 
-struct textLine {
-    SDL_Texture *outLine = NULL; 
-    SDL_FRect textPos; 
-
-    void destroy() {
-        if(outLine) {
-            SDL_DestroyTexture(outLine);
-            outLine = NULL;
-        }
-    }
-}; 
-
 class Graphics {
 //Audio handling members and constants
+//The beep is a precomputed wavetable exactly one period long (2205 samples hold 22 cycles of 440 Hz
+//and 33 of 660 Hz), fed by the SDL audio stream callback only as fast as the device consumes it
     static const int SAMPLING_RATE{44100};
     static constexpr float FREQUENCY1{440}; 
     static constexpr float FREQUENCY2{660};  
-    static const int BUFF_LENGTH{2048}; 
-    static const int LENGTH = BUFF_LENGTH * sizeof(float); 
+    static const int WAVE_LENGTH{SAMPLING_RATE / 20}; 
     SDL_AudioSpec spec{SDL_AUDIO_F32LE, 1, SAMPLING_RATE}; 
-    float audio_buf[BUFF_LENGTH]{}; 
-    float time1{}; 
-    float time2{};
+    float wavetable[WAVE_LENGTH]{}; 
+    int wavePosition{};                     //Only touched on the audio thread
+    atomic<bool> beeping{false}; 
+    int deviceFrames{};                     //Sample frames buffered by the audio device
+    atomic<telemetry*> stats{nullptr};      //Times each callback when set
+    atomic<bool> patternActive{false};      //XO-CHIP: play patternBits instead of the wavetable
+    atomic<uint64_t> patternBits[2]{};      //128 1-bit samples, first sample in bit 63 of word 0
+    atomic<uint32_t> patternStep{};         //Pattern bits per output sample, 16.16 fixed point
+    uint32_t patternPhase{};                //Only touched on the audio thread
+    static void SDLCALL audioCallback(void *userdata, SDL_AudioStream *stream, int additional, int total);
 
 //Game display section handling 
     int WINDOW_HEIGHT{1080}; 
@@ -36,8 +36,16 @@ class Graphics {
     SDL_Window *window{}; 
     SDL_Renderer *renderer{}; 
     SDL_Texture *screen{};
+    SDL_Texture *extendedScreen{};          //128x64 display of the SUPER-CHIP and XO-CHIP modes
+    bool extendedActive{};                  //Draw extendedScreen instead of screen
     SDL_AudioStream *stream{};
     SDL_FRect gamePosition{}; 
+    bool screenChanged{true}; 
+    pixelPipeline pipeline;                 //Packed rows to texture pixels: palette and persistence
+
+//Keypad mapping: CHIP-8 key for every scancode, NO_KEY where the scancode is not mapped
+    static constexpr uint8_t NO_KEY{0xFF};
+    uint8_t keyMap[SDL_SCANCODE_COUNT]{};
 
 //Debug handling members 
     float debugXpos{};
@@ -48,9 +56,22 @@ class Graphics {
     uint8_t registerLines[16]{}; 
     uint16_t stackLines[16]{}; 
     uint16_t pc{};
-    textLine regTextures[16]{}; 
-    textLine stackTextures[16]{}; 
-    textLine pcTexture{}; 
+
+//Glyph atlas: every character the overlay uses is rendered once into one texture
+//Each overlay line is a fixed row of atlas quads drawn with a single SDL_RenderGeometry call
+    static constexpr const char *ATLAS_GLYPHS{"0123456789ABCDEFVPx: "};
+    static const int ATLAS_SIZE{21};
+    static const int OVERLAY_LINES{33};            //16 registers, 16 stack entries, PC
+    static const int LINE_GLYPHS{9};
+    static const int OVERLAY_GLYPHS = OVERLAY_LINES * LINE_GLYPHS;
+    SDL_Texture *glyphAtlas{};
+    float glyphU[ATLAS_SIZE + 1]{};                 //Left edge of each glyph in texture coordinates
+    uint8_t glyphIndex[128]{};
+    SDL_Vertex overlayVertices[OVERLAY_GLYPHS * 4]{};
+    int overlayIndices[OVERLAY_GLYPHS * 6]{};
+    bool overlayValid{false};
+    void buildGlyphAtlas();
+    void layoutLine(int line, const char text[LINE_GLYPHS]);
 
 public:
 //Constructor & destructor function definitions
@@ -60,17 +81,27 @@ public:
 
 //Getter functions
     SDL_Renderer* getRenderer();
-    uint8_t *accessPixels();
+    uint8_t *accessPixels(int firstRow, int rowCount);
     int getPitch() const;
     
 //Methods to play sound and draw
-    void inputBuffer(uint8_t *inputBuffer, SDL_Event keyEvent);
-    void updateScreen(uint8_t registers[16], uint16_t stack[16], uint16_t pc);
+    bool loadKeyMap(const char *path);
+    bool inputBuffer(uint8_t *inputBuffer, SDL_Event keyEvent);
+    void updateDisplay(const uint64_t *chip8Screen, uint32_t dirtyRows);
+    void updateExtendedDisplay(const uint64_t planes[2][64][2], uint64_t dirtyRows);
+    void setPalette(const palette &colours);
+    void setPersistence(float kept);
+    bool updateScreen(const uint8_t registers[16], const uint16_t stack[16], uint16_t pc);
+    void setVSync(bool on);
+    void invalidate();
     void updatePixels();
-    void generateAudio(bool on); 
-    void playSound(bool on); 
+    void setBeep(bool on); 
+    void setAudioPattern(const uint8_t *pattern, uint8_t pitch);
+    void generateSamples(float *out, int count);
+    void setTelemetry(telemetry *stats);
+    float audioLatencyMs();
 
 //Debugging methods 
-    void updateHardware(uint8_t registers[16], uint16_t stack[16], uint16_t pc); 
+    void updateHardware(const uint8_t registers[16], const uint16_t stack[16], uint16_t pc); 
 };  
 
@@ -0,0 +1,188 @@
+#include "inputlog.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+struct inputLogHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t instructionsPerFrame;
+    uint32_t seed;
+    uint32_t changeCount;
+    uint64_t memoryHash;
+    uint64_t endCycle;
+    uint8_t mode;                           //Mode
+    uint8_t quirks;                         //Quirks
+    uint8_t reserved[6];
+};
+static_assert(sizeof(inputLogHeader) == 40, "inputLogHeader layout must not contain padding");
+
+// FNV-1a hash of the memory the mode addresses (4 KB, 64 KB for XO-CHIP), taken right after the ROM is loaded
+uint64_t inputLog::hashMemory(const chip8 &emulator) {
+    const uint8_t *memory = emulator.getMemory();
+    uint32_t length = emulator.getMode() == Mode::XoChip ? MEMORY_SIZE : 4096;
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(uint32_t i = 0; i < length; i++) {
+        hash ^= memory[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Pack a keypad into a 16-bit mask, bit K set while key K is held
+uint16_t inputLog::keyMask(const uint8_t keypad[16]) {
+    uint16_t mask = 0;
+    for(int i = 0; i < 16; i++) {
+        if(keypad[i]) mask |= 1u << i;
+    }
+    return mask;
+}
+
+// Start a new recording for a freshly loaded emulator
+void inputLog::begin(const chip8 &emulator, uint32_t seed, int instructionsPerFrame) {
+    this->seed = seed;
+    this->instructionsPerFrame = instructionsPerFrame;
+    mode = emulator.getMode();
+    quirks = emulator.getQuirks();
+    memoryHash = hashMemory(emulator);
+    endCycle = emulator.getCycles();
+    changes.clear();
+}
+
+// Note the keys held from cycle on, nothing is stored if they did not change
+void inputLog::record(uint64_t cycle, uint16_t keys) {
+    uint16_t previous = changes.empty() ? 0 : changes.back().keys;
+    if(keys != previous) 
+        changes.push_back({cycle, keys});
+    endCycle = cycle;
+}
+
+// Forget changes from cycle on, used when the session is rewound to that cycle
+void inputLog::truncate(uint64_t cycle) {
+    while(!changes.empty() && changes.back().cycle >= cycle) 
+        changes.pop_back();
+    endCycle = cycle;
+}
+
+// Write the log, false on I/O errors
+bool inputLog::save(const char *filename) const {
+    vector<uint8_t> data(sizeof(inputLogHeader));
+    inputLogHeader header = {INPUT_LOG_MAGIC, INPUT_LOG_VERSION, uint16_t(instructionsPerFrame), seed,
+                             uint32_t(changes.size()), memoryHash, endCycle, uint8_t(mode), uint8_t(quirks), {}};
+    memcpy(data.data(), &header, sizeof(header));
+    uint64_t last = 0;
+    for(const inputChange &change : changes) {
+        uint64_t delta = change.cycle - last;
+        last = change.cycle;
+        do {
+            data.push_back((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0));
+            delta >>= 7;
+        } while(delta);
+        data.push_back(change.keys & 0xFF);
+        data.push_back(change.keys >> 8);
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if(!file) {
+        cerr << "Could not open input log file!" << endl;
+        return false;
+    }
+    bool written = fwrite(data.data(), data.size(), 1, file) == 1;
+    written = (fclose(file) == 0) && written;
+    if(!written) 
+        cerr << "Could not write input log file!" << endl;
+    return written;
+}
+
+// Read a log written by save, false if the file is missing, truncated or of another version
+bool inputLog::load(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if(!file) {
+        cerr << "Could not open input log file!" << endl;
+        return false;
+    }
+    vector<uint8_t> data;
+    uint8_t buffer[4096];
+    for(size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+        data.insert(data.end(), buffer, buffer + n);
+    fclose(file);
+
+    inputLogHeader header;
+    if(data.size() < sizeof(header)) {
+        cerr << "Input log file is truncated!" << endl;
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if(header.magic != INPUT_LOG_MAGIC || header.version != INPUT_LOG_VERSION || header.instructionsPerFrame == 0
+       || header.mode > uint8_t(Mode::XoChip) || header.quirks > uint8_t(Quirks::XoChip)) {
+        cerr << "Input log has an unsupported format!" << endl;
+        return false;
+    }
+
+    vector<inputChange> loaded;
+    size_t pos = sizeof(header);
+    uint64_t cycle = 0;
+    for(uint32_t i = 0; i < header.changeCount; i++) {
+        uint64_t delta = 0;
+        int shift = 0;
+        while(pos < data.size() && (data[pos] & 0x80) && shift < 63) {
+            delta |= uint64_t(data[pos++] & 0x7F) << shift;
+            shift += 7;
+        }
+        if(pos + 3 > data.size()) {
+            cerr << "Input log file is truncated!" << endl;
+            return false;
+        }
+        delta |= uint64_t(data[pos++]) << shift;
+        cycle += delta;
+        loaded.push_back({cycle, uint16_t(data[pos] | (data[pos + 1] << 8))});
+        pos += 2;
+    }
+    seed = header.seed;
+    instructionsPerFrame = header.instructionsPerFrame;
+    mode = Mode(header.mode);
+    quirks = Quirks(header.quirks);
+    memoryHash = header.memoryHash;
+    endCycle = header.endCycle;
+    changes.swap(loaded);
+    return true;
+}
+
+// Execute count instructions, through the profiler if there is one
+static void runProfiled(chip8 &emulator, profiler *profile, long long count) {
+    if(profile)
+        profile->run(emulator, count);
+    else
+        emulator.runCycles(count);
+}
+
+// Re-run a recorded session on a freshly loaded emulator, as fast as the engine allows
+// Returns false if the emulator is not in the mode, or does not hold the ROM, the log was recorded with;
+// set the mode from the log before loading the ROM. The quirks profile of the log is applied here
+// With a profiler, execution goes through it so the replay is sampled
+bool replayInputLog(chip8 &emulator, const inputLog &log, profiler *profile) {
+    if(emulator.getMode() != log.mode) {
+        cerr << "Input log was recorded in a different mode!" << endl;
+        return false;
+    }
+    if(inputLog::hashMemory(emulator) != log.memoryHash || emulator.getCycles() != 0) {
+        cerr << "Input log was recorded with a different ROM!" << endl;
+        return false;
+    }
+    emulator.setSeed(log.seed);
+    emulator.setQuirks(log.quirks);
+    uint8_t *keypad = emulator.getKeypad();
+    size_t next = 0;
+    while(emulator.getCycles() < log.endCycle) {
+        uint64_t frameEnd = emulator.getCycles() + log.instructionsPerFrame;
+        for(; next < log.changes.size() && log.changes[next].cycle < frameEnd; next++) {
+            runProfiled(emulator, profile, log.changes[next].cycle - emulator.getCycles());
+            for(int i = 0; i < 16; i++)
+                keypad[i] = (log.changes[next].keys >> i) & 1u;
+        }
+        runProfiled(emulator, profile, frameEnd - emulator.getCycles());
+        emulator.decrementCounters();
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "CHIP8.hpp"
+#include "profiler.hpp"
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+/* Input logs
+ * A session is fully determined by the ROM, the mode, the quirks profile, the op_CXNN seed, the
+ * instructions per frame and the keypad changes, each stamped with the emulated cycle count at
+ * which it took effect.
+ * Replaying a log from power-on reproduces the session bit for bit at any speed.
+ *
+ * File layout: a fixed header (host byte order, like save-states) followed by one record per
+ * change: LEB128 cycle delta from the previous change, then the 16-bit key mask (bit K = key K).
+ */
+
+static const uint32_t INPUT_LOG_MAGIC{0x4E493843u};     //"C8IN" when stored little-endian
+static const uint16_t INPUT_LOG_VERSION{2};
+
+struct inputChange {
+    uint64_t cycle;
+    uint16_t keys;
+};
+
+class inputLog {
+public:
+    uint32_t seed{};
+    int instructionsPerFrame{};
+    Mode mode{Mode::Chip8};
+    Quirks quirks{Quirks::Default};
+    uint64_t memoryHash{};                  //FNV-1a of the memory the mode addresses at power-on, identifies the ROM
+    uint64_t endCycle{};                    //Cycle count when recording stopped
+    vector<inputChange> changes;
+
+    static uint64_t hashMemory(const chip8 &emulator);
+    static uint16_t keyMask(const uint8_t keypad[16]);
+
+    void begin(const chip8 &emulator, uint32_t seed, int instructionsPerFrame);
+    void record(uint64_t cycle, uint16_t keys);
+    void truncate(uint64_t cycle);
+    bool save(const char *filename) const;
+    bool load(const char *filename);
+};
+
+bool replayInputLog(chip8 &emulator, const inputLog &log, profiler *profile = nullptr);
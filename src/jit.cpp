@@ -0,0 +1,483 @@
+#include "jit.hpp"
+#include "CHIP8.hpp"
+#include <cstring>
+using namespace std;
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Opcodes with a native translation or a helper call, everything else is left to the interpreter
+static bool translatable(uint16_t opcode) {
+    switch(opcode & 0xF000) {
+        case 0x0000: return opcode == 0x00E0 || opcode == 0x00EE;
+        case 0x5000: return (opcode & 0x000F) == 0x0;
+        case 0x8000: {
+            uint16_t n = opcode & 0x000F;
+            return n <= 0x7 || n == 0xE;
+        }
+        case 0x9000: return (opcode & 0x000F) == 0x0;
+        case 0xE000: return (opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1;
+        case 0xF000:
+            switch(opcode & 0x00FF) {
+                case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29:
+                case 0x33: case 0x55: case 0x65:
+                    return true;
+            }
+            return false;
+    }
+    return true;
+}
+
+// Instructions after which control flow is no longer sequential
+static bool endsBlock(uint16_t opcode) {
+    switch(opcode & 0xF000) {
+        case 0x0000: return opcode == 0x00EE;
+        case 0x1000: case 0x2000: case 0x3000: case 0x4000:
+        case 0x5000: case 0x9000: case 0xB000: case 0xE000:
+            return true;
+    }
+    return false;
+}
+
+// Set up the code buffer with the enter and exit trampolines
+jit::jit(chip8 &cpu) : cpu(cpu) {
+    uint8_t *base = reinterpret_cast<uint8_t*>(&cpu);
+    offRegisters = static_cast<int32_t>(cpu.registers - base);
+    offPC = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&cpu.pc) - base);
+    offIndreg = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&cpu.indreg) - base);
+    offSP = static_cast<int32_t>(&cpu.sp - base);
+    offStack = static_cast<int32_t>(reinterpret_cast<uint8_t*>(cpu.stack) - base);
+    offDelay = static_cast<int32_t>(&cpu.delay - base);
+    offSound = static_cast<int32_t>(&cpu.soundTimer - base);
+    offKeypad = static_cast<int32_t>(cpu.keypad - base);
+
+#if defined(_WIN32)
+    code = static_cast<uint8_t*>(VirtualAlloc(NULL, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+#else
+    void *buffer = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    code = buffer == MAP_FAILED ? NULL : static_cast<uint8_t*>(buffer);
+#endif
+    if(!code)
+        return;
+
+    //enter(cpu, budget, block): save callee-saved registers, keep rsp 16-byte aligned with shadow space
+    enter = reinterpret_cast<long long (*)(chip8*, long long, void*)>(code);
+    emit(0x53);                                         //push rbx
+    emit(0x41); emit(0x54);                             //push r12
+    emit(0x55);                                         //push rbp
+    emit(0x48); emit(0x83); emit(0xEC); emit(0x20);     //sub rsp, 32
+#if defined(_WIN32)
+    emit(0x48); emit(0x89); emit(0xCB);                 //mov rbx, rcx
+    emit(0x49); emit(0x89); emit(0xD4);                 //mov r12, rdx
+    emit(0x41); emit(0xFF); emit(0xE0);                 //jmp r8
+#else
+    emit(0x48); emit(0x89); emit(0xFB);                 //mov rbx, rdi
+    emit(0x49); emit(0x89); emit(0xF4);                 //mov r12, rsi
+    emit(0xFF); emit(0xE2);                             //jmp rdx
+#endif
+
+    //exit: return the remaining budget
+    exitCode = code + codeUsed;
+    emit(0x4C); emit(0x89); emit(0xE0);                 //mov rax, r12
+    emit(0x48); emit(0x83); emit(0xC4); emit(0x20);     //add rsp, 32
+    emit(0x5D);                                         //pop rbp
+    emit(0x41); emit(0x5C);                             //pop r12
+    emit(0x5B);                                         //pop rbx
+    emit(0xC3);                                         //ret
+    codeStart = codeUsed;
+}
+
+// Release the code buffer
+jit::~jit() {
+    if(!code)
+        return;
+#if defined(_WIN32)
+    VirtualFree(code, 0, MEM_RELEASE);
+#else
+    munmap(code, CODE_SIZE);
+#endif
+}
+
+// True when this build can generate native code
+bool jit::supported() {
+    return true;
+}
+
+void jit::emit(uint8_t byte) {
+    code[codeUsed++] = byte;
+}
+
+void jit::emit16(uint16_t value) {
+    memcpy(code + codeUsed, &value, 2);
+    codeUsed += 2;
+}
+
+void jit::emit32(uint32_t value) {
+    memcpy(code + codeUsed, &value, 4);
+    codeUsed += 4;
+}
+
+void jit::emit64(uint64_t value) {
+    memcpy(code + codeUsed, &value, 8);
+    codeUsed += 8;
+}
+
+// ModRM and displacement for the operand [rbx + offset], reg is the register or opcode extension
+void jit::emitMem(uint8_t op, uint8_t reg, int32_t offset) {
+    emit(op);
+    emit(0x80 | (reg << 3) | 0x3);
+    emit32(static_cast<uint32_t>(offset));
+}
+
+// jmp rel32 to an address inside the code buffer
+void jit::emitJump(uint8_t *target) {
+    emit(0xE9);
+    emit32(static_cast<uint32_t>(target - (code + codeUsed + 4)));
+}
+
+// Leave the block for a statically known pc
+// The leading jmp falls through to the exit until a block at target exists, then it is patched to chain to it
+void jit::emitExit(uint16_t target) {
+    size_t site = codeUsed;
+    emit(0xE9);
+    emit32(0);
+    if(target <= 0x0FFE && blocks[target]) {
+        uint8_t *block = static_cast<uint8_t*>(blocks[target]);
+        uint32_t rel = static_cast<uint32_t>(block - (code + site + 5));
+        memcpy(code + site + 1, &rel, 4);
+    } else if(target <= 0x0FFE) {
+        pendingLinks[target].push_back(static_cast<uint32_t>(site));
+    }
+    emit(0x66); emitMem(0xC7, 0, offPC); emit16(target);  //mov word [pc], target
+    emitJump(exitCode);
+}
+
+// Leave the block for the pc stored in memory, jumping straight to its block when one exists
+void jit::emitDynamicExit() {
+    emit(0x0F); emitMem(0xB7, 0, offPC);                  //movzx eax, word [pc]
+    emit(0x3D); emit32(0x0FFE);                           //cmp eax, 0xFFE
+    emit(0x0F); emit(0x87);                               //ja exit
+    emit32(static_cast<uint32_t>(exitCode - (code + codeUsed + 4)));
+    emit(0x48); emit(0xB9); emit64(reinterpret_cast<uint64_t>(blocks));  //mov rcx, blocks
+    emit(0x48); emit(0x8B); emit(0x04); emit(0xC1);       //mov rax, [rcx + rax*8]
+    emit(0x48); emit(0x85); emit(0xC0);                   //test rax, rax
+    emit(0x0F); emit(0x84);                               //jz exit
+    emit32(static_cast<uint32_t>(exitCode - (code + codeUsed + 4)));
+    emit(0xFF); emit(0xE0);                               //jmp rax
+}
+
+// Call interpret(cpu, opcode)
+// After instructions that write memory, leave the block if the write hit translated code
+void jit::emitHelper(uint16_t opcode, bool checkDirty, uint16_t nextPC, int refund) {
+#if defined(_WIN32)
+    emit(0x48); emit(0x89); emit(0xD9);                   //mov rcx, rbx
+    emit(0xBA); emit32(opcode);                           //mov edx, opcode
+#else
+    emit(0x48); emit(0x89); emit(0xDF);                   //mov rdi, rbx
+    emit(0xBE); emit32(opcode);                           //mov esi, opcode
+#endif
+    emit(0x48); emit(0xB8); emit64(reinterpret_cast<uint64_t>(&jit::interpret));  //mov rax, interpret
+    emit(0xFF); emit(0xD0);                               //call rax
+    if(!checkDirty)
+        return;
+    emit(0x48); emit(0xB8); emit64(reinterpret_cast<uint64_t>(&dirty));  //mov rax, &dirty
+    emit(0x80); emit(0x38); emit(0x00);                   //cmp byte [rax], 0
+    emit(0x74); emit(18);                                 //je continue
+    emit(0x49); emit(0x83); emit(0xC4); emit(static_cast<uint8_t>(refund));  //add r12, refund
+    emit(0x66); emitMem(0xC7, 0, offPC); emit16(nextPC);  //mov word [pc], nextPC
+    emitJump(exitCode);
+}
+
+// Emit native code for one instruction at address, the index-th of a block of length instructions
+// Returns false when the instruction cannot be translated, ends is set for block terminators
+bool jit::emitInstruction(uint16_t opcode, uint16_t address, int index, int length, bool &ends) {
+    uint8_t X = (opcode & 0x0F00u) >> 8u;
+    uint8_t Y = (opcode & 0x00F0u) >> 4u;
+    uint8_t NN = opcode & 0x00FFu;
+    uint16_t NNN = opcode & 0x0FFFu;
+    uint16_t nextPC = address + 2;
+    int32_t VX = offRegisters + X;
+    int32_t VY = offRegisters + Y;
+    int32_t VF = offRegisters + 0xF;
+    size_t skipBranch = 0;
+    ends = endsBlock(opcode);
+
+    switch(opcode & 0xF000) {
+        case 0x0000:
+            if(opcode == 0x00E0) {
+                emitHelper(opcode, false, nextPC, 0);
+                return true;
+            }
+            //00EE: stack[sp] = 0, pc = stack[--sp], stack[sp] = 0
+            emit(0x0F); emitMem(0xB6, 0, offSP);                                  //movzx eax, byte [sp]
+            emit(0x66); emit(0xC7); emit(0x84); emit(0x43); emit32(offStack); emit16(0);  //mov word [stack + rax*2], 0
+            emitMem(0xFE, 1, offSP);                                              //dec byte [sp]
+            emit(0x0F); emitMem(0xB6, 0, offSP);                                  //movzx eax, byte [sp]
+            emit(0x0F); emit(0xB7); emit(0x8C); emit(0x43); emit32(offStack);     //movzx ecx, word [stack + rax*2]
+            emit(0x66); emit(0xC7); emit(0x84); emit(0x43); emit32(offStack); emit16(0);  //mov word [stack + rax*2], 0
+            emit(0x66); emitMem(0x89, 1, offPC);                                  //mov [pc], cx
+            emitDynamicExit();
+            return true;
+        case 0x1000:
+            emitExit(NNN);
+            return true;
+        case 0x2000:
+            emit(0x0F); emitMem(0xB6, 0, offSP);                                  //movzx eax, byte [sp]
+            emit(0x66); emit(0xC7); emit(0x84); emit(0x43); emit32(offStack); emit16(nextPC);  //mov word [stack + rax*2], nextPC
+            emitMem(0xFE, 0, offSP);                                              //inc byte [sp]
+            emitExit(NNN);
+            return true;
+        case 0x3000:
+        case 0x4000:
+            emitMem(0x80, 7, VX); emit(NN);                                       //cmp byte [VX], NN
+            break;
+        case 0x5000:
+        case 0x9000:
+            emitMem(0x8A, 0, VX);                                                 //mov al, [VX]
+            emitMem(0x3A, 0, VY);                                                 //cmp al, [VY]
+            break;
+        case 0x6000:
+            emitMem(0xC6, 0, VX); emit(NN);                                       //mov byte [VX], NN
+            return true;
+        case 0x7000:
+            emitMem(0x80, 0, VX); emit(NN);                                       //add byte [VX], NN
+            return true;
+        case 0x8000:
+            switch(opcode & 0x000F) {
+                case 0x0:
+                    emitMem(0x8A, 0, VY);                                         //mov al, [VY]
+                    emitMem(0x88, 0, VX);                                         //mov [VX], al
+                    return true;
+                case 0x1:
+                case 0x2:
+                case 0x3: {
+                    static const uint8_t ops[] = {0, 0x08, 0x20, 0x30};           //or, and, xor
+                    emitMem(0x8A, 0, VY);                                         //mov al, [VY]
+                    emitMem(ops[opcode & 0x3], 0, VX);                            //op [VX], al
+                    emitMem(0xC6, 0, VF); emit(0);                                //mov byte [VF], 0
+                    return true;
+                }
+                case 0x4:
+                    emit(0x0F); emitMem(0xB6, 0, VY);                             //movzx eax, byte [VY]
+                    emit(0x0F); emitMem(0xB6, 1, VX);                             //movzx ecx, byte [VX]
+                    emit(0x01); emit(0xC8);                                       //add eax, ecx
+                    emitMem(0x88, 0, VX);                                         //mov [VX], al
+                    emit(0xC1); emit(0xE8); emit(8);                              //shr eax, 8
+                    emitMem(0x88, 0, VF);                                         //mov [VF], al
+                    return true;
+                case 0x5:
+                    emitMem(0x8A, 0, VX);                                         //mov al, [VX]
+                    emitMem(0x8A, 1, VY);                                         //mov cl, [VY]
+                    emit(0x28); emit(0xC8);                                       //sub al, cl
+                    emit(0x0F); emit(0x93); emit(0xC2);                           //setae dl
+                    emitMem(0x88, 0, VX);                                         //mov [VX], al
+                    emitMem(0x88, 2, VF);                                         //mov [VF], dl
+                    return true;
+                case 0x6:
+                case 0xE:
+                    emit(0x0F); emitMem(0xB6, 0, VY);                             //movzx eax, byte [VY]
+                    emit(0x89); emit(0xC1);                                       //mov ecx, eax
+                    if((opcode & 0x000F) == 0x6) {
+                        emit(0xD1); emit(0xE8);                                   //shr eax, 1
+                        emit(0x83); emit(0xE1); emit(0x01);                       //and ecx, 1
+                    } else {
+                        emit(0xD1); emit(0xE0);                                   //shl eax, 1
+                        emit(0xC1); emit(0xE9); emit(7);                          //shr ecx, 7
+                    }
+                    emitMem(0x88, 0, VX);                                         //mov [VX], al
+                    emitMem(0x88, 1, VF);                                         //mov [VF], cl
+                    return true;
+                case 0x7:
+                    emitMem(0x8A, 0, VY);                                         //mov al, [VY]
+                    emitMem(0x2A, 0, VX);                                         //sub al, [VX]
+                    emitMem(0x88, 0, VX);                                         //mov [VX], al
+                    emitMem(0x8A, 0, VY);                                         //mov al, [VY]
+                    emitMem(0x3A, 0, VX);                                         //cmp al, [VX]
+                    emit(0x0F); emit(0x93); emit(0xC2);                           //setae dl
+                    emitMem(0x88, 2, VF);                                         //mov [VF], dl
+                    return true;
+            }
+            return false;
+        case 0xA000:
+            emit(0x66); emitMem(0xC7, 0, offIndreg); emit16(NNN);                 //mov word [I], NNN
+            return true;
+        case 0xB000:
+            emit(0x0F); emitMem(0xB6, 0, offRegisters);                           //movzx eax, byte [V0]
+            emit(0x05); emit32(NNN);                                              //add eax, NNN
+            emit(0x66); emitMem(0x89, 0, offPC);                                  //mov [pc], ax
+            emitDynamicExit();
+            return true;
+        case 0xC000:
+        case 0xD000:
+            emitHelper(opcode, false, nextPC, 0);
+            return true;
+        case 0xE000:
+            emit(0x0F); emitMem(0xB6, 0, VX);                                     //movzx eax, byte [VX]
+            emit(0x80); emit(0xBC); emit(0x03); emit32(offKeypad); emit(0);       //cmp byte [keypad + rax], 0
+            break;
+        case 0xF000:
+            switch(opcode & 0x00FF) {
+                case 0x07:
+                    emitMem(0x8A, 0, offDelay);                                   //mov al, [delay]
+                    emitMem(0x88, 0, VX);                                         //mov [VX], al
+                    return true;
+                case 0x15:
+                case 0x18:
+                    emitMem(0x8A, 0, VX);                                         //mov al, [VX]
+                    emitMem(0x88, 0, NN == 0x15 ? offDelay : offSound);           //mov [timer], al
+                    return true;
+                case 0x1E:
+                    emit(0x0F); emitMem(0xB6, 0, VX);                             //movzx eax, byte [VX]
+                    emit(0x66); emitMem(0x01, 0, offIndreg);                      //add word [I], ax
+                    return true;
+                case 0x29:
+                    emit(0x0F); emitMem(0xB6, 0, VX);                             //movzx eax, byte [VX]
+                    emit(0x8D); emit(0x44); emit(0x80); emit(0x50);               //lea eax, [rax + rax*4 + 0x50]
+                    emit(0x66); emitMem(0x89, 0, offIndreg);                      //mov [I], ax
+                    return true;
+                case 0x33:
+                case 0x55:
+                    emitHelper(opcode, true, nextPC, length - index - 1);
+                    return true;
+                case 0x65:
+                    emitHelper(opcode, false, nextPC, 0);
+                    return true;
+            }
+            return false;
+    }
+
+    //Skip instructions: flags were set above, branch to the not-skipped exit
+    bool skipWhenEqual = (opcode & 0xF000) == 0x3000 || (opcode & 0xF000) == 0x5000 || opcode == (0xE000 | (X << 8) | 0xA1);
+    emit(0x0F); emit(skipWhenEqual ? 0x85 : 0x84);                                //jne / je not skipped
+    skipBranch = codeUsed;
+    emit32(0);
+    emitExit(address + 4);
+    uint32_t rel = static_cast<uint32_t>(codeUsed - (skipBranch + 4));
+    memcpy(code + skipBranch, &rel, 4);
+    emitExit(nextPC);
+    return true;
+}
+
+// Translate the block starting at address, returns its entry point or NULL when the first instruction has no translation
+void *jit::compile(uint16_t address) {
+    if(CODE_SIZE - codeUsed < MAX_BLOCK * 160)
+        reset();
+
+    int length = 0;
+    for(uint16_t pc = address; length < MAX_BLOCK && pc <= 0x0FFE; pc += 2) {
+        uint16_t opcode = (cpu.memory[pc] << 8u) | cpu.memory[pc + 1];
+        if(!translatable(opcode))
+            break;
+        length++;
+        if(endsBlock(opcode))
+            break;
+    }
+    if(length == 0) {
+        interpretOnly[address] = 1;
+        return NULL;
+    }
+
+    uint8_t *entry = code + codeUsed;
+    blocks[address] = entry;
+    blockLength[address] = static_cast<uint8_t>(length);
+
+    //Budget check: leave with pc = address when fewer than length instructions remain
+    emit(0x49); emit(0x83); emit(0xFC); emit(static_cast<uint8_t>(length));       //cmp r12, length
+    emit(0x7D); emit(14);                                                         //jge run
+    emit(0x66); emitMem(0xC7, 0, offPC); emit16(address);                         //mov word [pc], address
+    emitJump(exitCode);
+    emit(0x49); emit(0x83); emit(0xEC); emit(static_cast<uint8_t>(length));       //sub r12, length
+
+    uint16_t pc = address;
+    bool ends = false;
+    for(int i = 0; i < length; i++, pc += 2) {
+        uint16_t opcode = (cpu.memory[pc] << 8u) | cpu.memory[pc + 1];
+        emitInstruction(opcode, pc, i, length, ends);
+    }
+    if(!ends)
+        emitExit(pc);
+
+    for(int i = 0; i < length * 2; i++)
+        translated[(address + i) & 0x0FFFu] = 1;
+    for(uint32_t site : pendingLinks[address]) {
+        uint32_t rel = static_cast<uint32_t>(entry - (code + site + 5));
+        memcpy(code + site + 1, &rel, 4);
+    }
+    pendingLinks[address].clear();
+    return entry;
+}
+
+// Drop every translated block
+void jit::reset() {
+    codeUsed = codeStart;
+    memset(blocks, 0, sizeof(blocks));
+    memset(blockLength, 0, sizeof(blockLength));
+    memset(interpretOnly, 0, sizeof(interpretOnly));
+    memset(translated, 0, sizeof(translated));
+    for(vector<uint32_t> &links : pendingLinks)
+        links.clear();
+    dirty = 0;
+}
+
+// Run count instructions, translated blocks where possible and the interpreter otherwise
+// Returns false if no executable memory could be allocated
+bool jit::run(long long count) {
+    if(!code)
+        return false;
+    while(count > 0) {
+        if(dirty)
+            reset();
+        uint16_t pc = cpu.pc;
+        void *block = NULL;
+        if(pc <= 0x0FFE && !interpretOnly[pc]) {
+            block = blocks[pc];
+            if(!block)
+                block = compile(pc);
+        }
+        if(!block || blockLength[pc] > count) {
+            cpu.emulateCycle();
+            count--;
+            continue;
+        }
+        count = enter(&cpu, count, block);
+    }
+    return true;
+}
+
+// Memory bytes [address, address + length) were written
+void jit::invalidate(uint16_t address, uint16_t length) {
+    for(uint16_t i = 0; i < length; i++) {
+        if(translated[(address + i) & 0x0FFFu])
+            dirty = 1;
+    }
+    for(uint16_t i = 0; i <= length; i++)
+        interpretOnly[(address - 1 + i) & 0x0FFFu] = 0;
+}
+
+// All of memory may have changed
+void jit::flush() {
+    if(code)
+        reset();
+}
+
+// Helper called from generated code for instructions without a native translation
+void jit::interpret(chip8 *cpu, uint32_t opcode) {
+    cpu->opcode = static_cast<uint16_t>(opcode);
+    cpu->decodeExe(cpu->opcode);
+}
+
+#else
+
+jit::jit(chip8 &cpu) : cpu(cpu) {}
+jit::~jit() {}
+bool jit::supported() { return false; }
+bool jit::run(long long) { return false; }
+void jit::invalidate(uint16_t, uint16_t) {}
+void jit::flush() {}
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+class chip8;
+
+/* x86-64 dynamic recompiler for CHIP-8 basic blocks
+ *
+ * A block starts at any pc and ends after 1NNN, 2NNN, 00EE, BNNN or a skip instruction.
+ * Blocks with static successors are chained with patched jumps, 00EE and BNNN look their
+ * target up in the block table. op_FX0A and opcodes without a native translation are run by
+ * the interpreter between blocks, op_DXYN, op_CXNN and the memory instructions call back into decodeExe.
+ *
+ * Registers used by generated code: rbx = chip8 object, r12 = remaining instruction budget
+ * V0 - VF are addressed as byte operands off rbx, x86-64 has too few registers to pin all 16
+ *
+ * Writes into translated memory set a flag that makes the running block exit, the whole
+ * translation cache is then dropped before the next block runs
+ */
+
+class jit {
+    static const size_t CODE_SIZE{1 << 20};
+    static const int MAX_BLOCK{64};
+
+    chip8 &cpu;
+    uint8_t *code{};
+    size_t codeUsed{};
+    size_t codeStart{};                     //First byte after the enter/exit trampolines
+    uint8_t *exitCode{};
+    long long (*enter)(chip8 *cpu, long long budget, void *block){};
+
+    void *blocks[4096]{};                   //Entry point of the block starting at each address
+    uint8_t blockLength[4096]{};            //Instructions in that block
+    uint8_t interpretOnly[4096]{};          //Addresses whose first instruction has no translation
+    uint8_t translated[4096]{};             //Memory bytes covered by some block
+    vector<uint32_t> pendingLinks[4096];    //Unlinked exits (code offsets) waiting for a block at that address
+    volatile uint8_t dirty{};
+
+    //Offsets of chip8 members from the object, addressed through rbx
+    int32_t offRegisters{};
+    int32_t offPC{};
+    int32_t offIndreg{};
+    int32_t offSP{};
+    int32_t offStack{};
+    int32_t offDelay{};
+    int32_t offSound{};
+    int32_t offKeypad{};
+
+    void emit(uint8_t byte);
+    void emit16(uint16_t value);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    void emitMem(uint8_t op, uint8_t reg, int32_t offset);
+    void emitJump(uint8_t *target);
+    void emitExit(uint16_t target);
+    void emitDynamicExit();
+    void emitHelper(uint16_t opcode, bool checkDirty, uint16_t nextPC, int refund);
+    bool emitInstruction(uint16_t opcode, uint16_t address, int index, int length, bool &ends);
+    void *compile(uint16_t address);
+    void reset();
+
+    static void interpret(chip8 *cpu, uint32_t opcode);
+
+public:
+    explicit jit(chip8 &cpu);
+    ~jit();
+    jit(const jit&) = delete;
+    jit &operator=(const jit&) = delete;
+
+    static bool supported();
+    bool run(long long count);
+    void invalidate(uint16_t address, uint16_t length);
+    void flush();
+};
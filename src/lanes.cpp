@@ -0,0 +1,625 @@
+#include "lanes.hpp"
+#include <cstring>
+#include <iostream>
+#include <random>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+static const int LANES{chip8Lanes::MAX_LANES};
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+//A vector of lanes is one or more machine vectors: 1 or 2 (bytes) and 2 or 4 (words) with AVX2 or SSE2
+#if defined(__AVX2__)
+typedef __m256i simd;
+#define VEC(op) _mm256_##op
+#define VEC_BITS(op) _mm256_##op##_si256
+#else
+typedef __m128i simd;
+#define VEC(op) _mm_##op
+#define VEC_BITS(op) _mm_##op##_si128
+#endif
+static const int BYTE_CHUNKS{int(LANES / sizeof(simd))};
+static const int WORD_CHUNKS{int(2 * LANES / sizeof(simd))};
+
+struct laneBytes {
+    simd v[BYTE_CHUNKS];
+};
+
+struct laneWords {
+    simd v[WORD_CHUNKS];
+};
+
+#define LANE_MAP(type, chunks, expression) \
+    type r; \
+    for(int i = 0; i < chunks; i++) r.v[i] = expression; \
+    return r;
+
+static inline laneBytes load(const uint8_t *lanes) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC_BITS(loadu)((const simd*)lanes + i)) }
+static inline laneWords load(const uint16_t *lanes) { LANE_MAP(laneWords, WORD_CHUNKS, VEC_BITS(loadu)((const simd*)lanes + i)) }
+static inline laneBytes splat(uint8_t value) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC(set1_epi8)(char(value))) }
+static inline laneWords splat16(uint16_t value) { LANE_MAP(laneWords, WORD_CHUNKS, VEC(set1_epi16)(short(value))) }
+
+static inline void store(uint8_t *lanes, const laneBytes &value) {
+    for(int i = 0; i < BYTE_CHUNKS; i++) VEC_BITS(storeu)((simd*)lanes + i, value.v[i]);
+}
+
+static inline void store(uint16_t *lanes, const laneWords &value) {
+    for(int i = 0; i < WORD_CHUNKS; i++) VEC_BITS(storeu)((simd*)lanes + i, value.v[i]);
+}
+
+static inline laneBytes operator+(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC(add_epi8)(a.v[i], b.v[i])) }
+static inline laneBytes operator-(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC(sub_epi8)(a.v[i], b.v[i])) }
+static inline laneBytes operator&(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC_BITS(and)(a.v[i], b.v[i])) }
+static inline laneBytes operator|(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC_BITS(or)(a.v[i], b.v[i])) }
+static inline laneBytes operator^(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC_BITS(xor)(a.v[i], b.v[i])) }
+static inline laneBytes operator~(const laneBytes &a) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC_BITS(xor)(a.v[i], VEC(set1_epi8)(-1))) }
+static inline laneWords operator+(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, WORD_CHUNKS, VEC(add_epi16)(a.v[i], b.v[i])) }
+static inline laneWords operator&(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, WORD_CHUNKS, VEC_BITS(and)(a.v[i], b.v[i])) }
+static inline laneWords operator|(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, WORD_CHUNKS, VEC_BITS(or)(a.v[i], b.v[i])) }
+static inline laneWords operator~(const laneWords &a) { LANE_MAP(laneWords, WORD_CHUNKS, VEC_BITS(xor)(a.v[i], VEC(set1_epi8)(-1))) }
+
+// 0xFF (0xFFFF) in lanes where a == b
+static inline laneBytes equal(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, BYTE_CHUNKS, VEC(cmpeq_epi8)(a.v[i], b.v[i])) }
+static inline laneWords equal(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, WORD_CHUNKS, VEC(cmpeq_epi16)(a.v[i], b.v[i])) }
+
+// 0xFF in lanes where a < b, unsigned: max(a, b) differs from a
+static inline laneBytes below(const laneBytes &a, const laneBytes &b) {
+    LANE_MAP(laneBytes, BYTE_CHUNKS, VEC_BITS(andnot)(VEC(cmpeq_epi8)(VEC(max_epu8)(a.v[i], b.v[i]), a.v[i]), VEC(set1_epi8)(-1)))
+}
+
+// Logical shift of each byte, there is no byte shift instruction so the bits crossing from the neighbour are masked off
+static inline laneBytes shiftRight(const laneBytes &a, int bits) {
+    LANE_MAP(laneBytes, BYTE_CHUNKS, VEC_BITS(and)(VEC(srli_epi16)(a.v[i], bits), VEC(set1_epi8)(char(0xFF >> bits))))
+}
+
+static inline laneWords shiftLeft(const laneWords &a, int bits) { LANE_MAP(laneWords, WORD_CHUNKS, VEC(slli_epi16)(a.v[i], bits)) }
+
+// Zero-extend each lane to 16 bits
+// AVX2 unpacks within 128-bit halves, so it converts each half instead to keep the lane order
+static inline laneWords widen(const laneBytes &a) {
+    laneWords r;
+    for(int i = 0; i < BYTE_CHUNKS; i++) {
+#if defined(__AVX2__)
+        r.v[2 * i] = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(a.v[i]));
+        r.v[2 * i + 1] = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(a.v[i], 1));
+#else
+        r.v[2 * i] = _mm_unpacklo_epi8(a.v[i], _mm_setzero_si128());
+        r.v[2 * i + 1] = _mm_unpackhi_epi8(a.v[i], _mm_setzero_si128());
+#endif
+    }
+    return r;
+}
+
+// 0xFF/0x00 byte mask to a 0xFFFF/0x0000 word mask
+static inline laneWords widenMask(const laneBytes &mask) {
+    laneWords r;
+    for(int i = 0; i < BYTE_CHUNKS; i++) {
+#if defined(__AVX2__)
+        r.v[2 * i] = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask.v[i]));
+        r.v[2 * i + 1] = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask.v[i], 1));
+#else
+        r.v[2 * i] = _mm_unpacklo_epi8(mask.v[i], mask.v[i]);
+        r.v[2 * i + 1] = _mm_unpackhi_epi8(mask.v[i], mask.v[i]);
+#endif
+    }
+    return r;
+}
+
+// 0xFFFF/0x0000 word mask to a 0xFF/0x00 byte mask
+static inline laneBytes narrowMask(const laneWords &mask) {
+    laneBytes r;
+    for(int i = 0; i < BYTE_CHUNKS; i++) {
+#if defined(__AVX2__)
+        r.v[i] = _mm256_permute4x64_epi64(_mm256_packs_epi16(mask.v[2 * i], mask.v[2 * i + 1]), 0xD8);
+#else
+        r.v[i] = _mm_packs_epi16(mask.v[2 * i], mask.v[2 * i + 1]);
+#endif
+    }
+    return r;
+}
+
+// Bit per lane from the top bit of each byte
+static inline uint32_t bitsOf(const laneBytes &mask) {
+    uint32_t bits = 0;
+    for(int i = 0; i < BYTE_CHUNKS; i++)
+        bits |= uint32_t(VEC(movemask_epi8)(mask.v[i])) << (i * sizeof(simd));
+    return bits;
+}
+#undef LANE_MAP
+#else
+//Plain arrays on hosts without SSE2
+struct laneBytes {
+    uint8_t v[LANES];
+};
+
+struct laneWords {
+    uint16_t v[LANES];
+};
+
+#define LANE_MAP(type, expression) \
+    type r; \
+    for(int i = 0; i < LANES; i++) r.v[i] = expression; \
+    return r;
+
+static inline laneBytes load(const uint8_t *lanes) { LANE_MAP(laneBytes, lanes[i]) }
+static inline laneWords load(const uint16_t *lanes) { LANE_MAP(laneWords, lanes[i]) }
+static inline laneBytes splat(uint8_t value) { LANE_MAP(laneBytes, value) }
+static inline laneWords splat16(uint16_t value) { LANE_MAP(laneWords, value) }
+static inline void store(uint8_t *lanes, const laneBytes &value) { memcpy(lanes, value.v, sizeof(value.v)); }
+static inline void store(uint16_t *lanes, const laneWords &value) { memcpy(lanes, value.v, sizeof(value.v)); }
+static inline laneBytes operator+(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, uint8_t(a.v[i] + b.v[i])) }
+static inline laneBytes operator-(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, uint8_t(a.v[i] - b.v[i])) }
+static inline laneBytes operator&(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, a.v[i] & b.v[i]) }
+static inline laneBytes operator|(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, a.v[i] | b.v[i]) }
+static inline laneBytes operator^(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, a.v[i] ^ b.v[i]) }
+static inline laneBytes operator~(const laneBytes &a) { LANE_MAP(laneBytes, uint8_t(~a.v[i])) }
+static inline laneWords operator+(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, uint16_t(a.v[i] + b.v[i])) }
+static inline laneWords operator&(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, a.v[i] & b.v[i]) }
+static inline laneWords operator|(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, a.v[i] | b.v[i]) }
+static inline laneWords operator~(const laneWords &a) { LANE_MAP(laneWords, uint16_t(~a.v[i])) }
+static inline laneBytes equal(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, a.v[i] == b.v[i] ? 0xFF : 0) }
+static inline laneWords equal(const laneWords &a, const laneWords &b) { LANE_MAP(laneWords, a.v[i] == b.v[i] ? 0xFFFF : 0) }
+static inline laneBytes below(const laneBytes &a, const laneBytes &b) { LANE_MAP(laneBytes, a.v[i] < b.v[i] ? 0xFF : 0) }
+static inline laneBytes shiftRight(const laneBytes &a, int bits) { LANE_MAP(laneBytes, a.v[i] >> bits) }
+static inline laneWords shiftLeft(const laneWords &a, int bits) { LANE_MAP(laneWords, uint16_t(a.v[i] << bits)) }
+static inline laneWords widen(const laneBytes &a) { LANE_MAP(laneWords, a.v[i]) }
+static inline laneWords widenMask(const laneBytes &mask) { LANE_MAP(laneWords, mask.v[i] ? 0xFFFF : 0) }
+static inline laneBytes narrowMask(const laneWords &mask) { LANE_MAP(laneBytes, mask.v[i] ? 0xFF : 0) }
+
+static inline uint32_t bitsOf(const laneBytes &mask) {
+    uint32_t bits = 0;
+    for(int i = 0; i < LANES; i++) bits |= uint32_t(mask.v[i] >> 7) << i;
+    return bits;
+}
+#undef LANE_MAP
+#endif
+
+// a in lanes where mask is set, b elsewhere
+template<typename V> static inline V select(const V &mask, const V &a, const V &b) {
+    return (a & mask) | (b & ~mask);
+}
+
+// Byte mask with 0xFF in every lane whose bit is set
+// Each group of 8 bits is spread to 8 bytes with a multiply, no table or per-lane loop
+static inline laneBytes maskOf(uint32_t bits) {
+    uint64_t bytes[LANES / 8];
+    for(int i = 0; i < LANES / 8; i++) {
+        uint64_t spread = (((bits >> (8 * i)) & 0xFFu) * 0x0101010101010101ull) & 0x8040201008040201ull;
+        bytes[i] = (((spread + 0x7F7F7F7F7F7F7F7Full) & 0x8080808080808080ull) >> 7) * 0xFFu;
+    }
+    laneBytes mask;
+    memcpy(&mask, bytes, sizeof(mask));
+    return mask;
+}
+
+// Index of the lowest set bit, bits must not be zero
+static inline int lowestLane(uint32_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctz(bits);
+#else
+    int lane = 0;
+    while(!(bits & 1u)) {
+        bits >>= 1;
+        lane++;
+    }
+    return lane;
+#endif
+}
+
+//Loop over the lanes whose bit is set in bits, lowest first
+#define FOR_EACH_LANE(bits) \
+    for(uint32_t pending = (bits); pending; pending &= pending - 1) \
+        if(int lane = lowestLane(pending); true)
+
+//Rotate a 64 bit row right, used to place sprite bytes with horizontal wrap
+static inline uint64_t rotateRow(uint64_t row, unsigned shift) {
+    shift &= 63u;
+    return (row >> shift) | (row << ((64u - shift) & 63u));
+}
+
+// Group of lanes lanes wide (1 to MAX_LANES), empty until a ROM is loaded
+chip8Lanes::chip8Lanes(int lanes)
+    : memory(new uint8_t[size_t(MAX_LANES) * 4096]()), laneCount(max(1, min(lanes, MAX_LANES))) {}
+
+uint8_t *chip8Lanes::laneMemory(int lane) {
+    return memory.get() + size_t(lane) * 4096;
+}
+
+// Power on every lane with the ROM loaded, each lane gets its own random seed
+// All lanes run until setRunning stops them
+bool chip8Lanes::loadROM(const uint8_t *data, size_t length) {
+    chip8 boot;
+    if(!boot.loadROM(data, length))
+        return false;
+    chip8State state;
+    boot.saveState(state);
+    memcpy(image, state.memory, sizeof(image));
+    memset(written, 0, sizeof(written));
+    random_device rd;
+    for(int lane = 0; lane < laneCount; lane++) {
+        loadState(lane, state);
+        setSeed(lane, rd());
+    }
+    running = laneCount == 32 ? 0xFFFFFFFFu : (1u << laneCount) - 1;
+    groups = 0;
+    return true;
+}
+
+// Copy one lane into a save-state, which chip8::loadState accepts
+// The opcode latch is not kept per lane and is saved as 0, lanes are always in classic mode
+void chip8Lanes::saveState(int lane, chip8State &state) const {
+    state.magic = STATE_MAGIC;
+    state.version = STATE_VERSION;
+    state.mode = uint8_t(Mode::Chip8);
+    state.hires = 0;
+    state.size = uint32_t(chip8::stateSize(Mode::Chip8));
+    state.planeMask = 1;
+    state.pitch = 64;
+    state.patternLoaded = 0;
+    state.reserved0 = 0;
+    memcpy(state.memory, memory.get() + size_t(lane) * 4096, 4096);
+    memcpy(state.screen, screens[lane], sizeof(state.screen));
+    memset(state.flags, 0, sizeof(state.flags));
+    memset(state.audioPattern, 0, sizeof(state.audioPattern));
+    state.rng = rng[lane];
+    state.cycles = cycles[lane];
+    for(int i = 0; i < 16; i++) {
+        state.stack[i] = stack[i][lane];
+        state.registers[i] = registers[i][lane];
+        state.keypad[i] = (keys[lane] >> i) & 1u;
+    }
+    state.indreg = indreg[lane];
+    state.pc = pc[lane];
+    state.opcode = 0;
+    state.sp = sp[lane];
+    state.delay = delay[lane];
+    state.soundTimer = soundTimer[lane];
+    memset(state.reserved, 0, sizeof(state.reserved));
+}
+
+// Restore one lane from a save-state, false (and nothing changed) if it is not a classic-mode snapshot of this version
+// Only the first 4 KB of memory are kept
+bool chip8Lanes::loadState(int lane, const chip8State &state) {
+    if(state.magic != STATE_MAGIC || state.version != STATE_VERSION || state.mode != uint8_t(Mode::Chip8)
+       || state.size != chip8::stateSize(Mode::Chip8)) {
+        cerr << "Save-state has an unsupported format!" << endl;
+        return false;
+    }
+    for(int i = 0; i < 4096; i++) {
+        if(state.memory[i] != image[i])
+            written[i] = 1;
+    }
+    memcpy(laneMemory(lane), state.memory, 4096);
+    memcpy(screens[lane], state.screen, sizeof(screens[lane]));
+    rng[lane] = state.rng ? state.rng : 1u;
+    cycles[lane] = state.cycles;
+    keys[lane] = 0;
+    for(int i = 0; i < 16; i++) {
+        stack[i][lane] = state.stack[i];
+        registers[i][lane] = state.registers[i];
+        keys[lane] |= (state.keypad[i] ? 1u : 0u) << i;
+    }
+    indreg[lane] = state.indreg;
+    pc[lane] = state.pc;
+    sp[lane] = state.sp;
+    delay[lane] = state.delay;
+    soundTimer[lane] = state.soundTimer;
+    return true;
+}
+
+// Reseed one lane's op_CXNN generator, the same sequence chip8::setSeed gives
+void chip8Lanes::setSeed(int lane, uint32_t seed) {
+    rng[lane] = chip8::seedState(seed);
+}
+
+// Set one lane's keypad, bit K = key K
+void chip8Lanes::setKeys(int lane, uint16_t mask) {
+    keys[lane] = mask;
+}
+
+// Start or stop a lane, stopped lanes keep their state and do not run or tick
+void chip8Lanes::setRunning(int lane, bool on) {
+    if(on)
+        running |= 1u << lane;
+    else
+        running &= ~(1u << lane);
+}
+
+bool chip8Lanes::isRunning(int lane) const {
+    return (running >> lane) & 1u;
+}
+
+// Run every running lane for one instruction, one group per distinct pc
+void chip8Lanes::step() {
+    laneWords pcs = load(pc);
+    uint32_t pending = running;
+    while(pending) {
+        int lead = lowestLane(pending);
+        uint16_t at = pc[lead];
+        uint32_t group = pending & bitsOf(narrowMask(equal(pcs, splat16(at))));
+
+        //Lanes share the loaded code unless one of them wrote to it, then compare opcodes too
+        const uint8_t *code = laneMemory(lead);
+        uint16_t address = at & 0x0FFFu;
+        uint16_t next = (at + 1) & 0x0FFFu;
+        uint16_t opcode = (code[address] << 8u) | code[next];
+        if(written[address] | written[next]) {
+            for(uint32_t rest = group & (group - 1); rest; rest &= rest - 1) {
+                int lane = lowestLane(rest);
+                const uint8_t *other = laneMemory(lane);
+                if(((other[address] << 8u) | other[next]) != opcode)
+                    group &= ~(1u << lane);
+            }
+        }
+        execute(at, opcode, group);
+        pending &= ~group;
+        groups++;
+    }
+}
+
+// True when every lane of group is at the same call depth, so calls and returns use one stack row
+bool chip8Lanes::sameDepth(uint32_t group) const {
+    return (bitsOf(equal(load(sp), splat(sp[lowestLane(group)]))) & group) == group;
+}
+
+// Execute opcode, fetched from pc at, in every lane of group
+void chip8Lanes::execute(uint16_t at, uint16_t opcode, uint32_t group) {
+    uint8_t X = (opcode & 0x0F00u) >> 8u;
+    uint8_t Y = (opcode & 0x00F0u) >> 4u;
+    uint8_t NN = opcode & 0x00FFu;
+    uint16_t NNN = opcode & 0x0FFFu;
+    laneBytes mask = maskOf(group);
+    laneWords mask16 = widenMask(mask);
+    laneBytes one = splat(1);
+    laneBytes skip = splat(0);                  //Lanes whose condition skips the next instruction
+    auto reg = [this](int index) { return load(registers[index]); };
+    auto setReg = [this, &mask](int index, const laneBytes &value) {
+        store(registers[index], select(mask, value, load(registers[index])));
+    };
+
+    store(pc, select(mask16, splat16(at + 2), load(pc)));
+    switch(opcode & 0xF000) {
+        case 0x0000:
+            if(opcode == 0x00E0) executeEach(opcode, group);
+            else if(opcode == 0x00EE && !sameDepth(group)) executeEach(opcode, group);
+            else if(opcode == 0x00EE) {
+                //Pop the return address row of the group's common depth, clearing both rows like op_00EE
+                uint8_t depth = sp[lowestLane(group)];
+                store(stack[depth & 15u], select(mask16, splat16(0), load(stack[depth & 15u])));
+                depth--;
+                store(pc, select(mask16, load(stack[depth & 15u]), load(pc)));
+                store(stack[depth & 15u], select(mask16, splat16(0), load(stack[depth & 15u])));
+                store(sp, select(mask, load(sp) - one, load(sp)));
+            }
+            break;
+        case 0x1000: store(pc, select(mask16, splat16(NNN), load(pc))); break;
+        case 0x2000:
+            if(!sameDepth(group)) {
+                executeEach(opcode, group);
+            } else {
+                uint8_t depth = sp[lowestLane(group)] & 15u;
+                store(stack[depth], select(mask16, splat16(at + 2), load(stack[depth])));
+                store(sp, select(mask, load(sp) + one, load(sp)));
+                store(pc, select(mask16, splat16(NNN), load(pc)));
+            }
+            break;
+        case 0x3000: skip = equal(reg(X), splat(NN)); break;
+        case 0x4000: skip = ~equal(reg(X), splat(NN)); break;
+        case 0x5000: skip = equal(reg(X), reg(Y)); break;
+        case 0x6000: setReg(X, splat(NN)); break;
+        case 0x7000: setReg(X, reg(X) + splat(NN)); break;
+        case 0x8000: {
+            //Operands are read first, VF is written last so it wins when X is F
+            laneBytes x = reg(X);
+            laneBytes y = reg(Y);
+            switch(opcode & 0x000F) {
+                case 0x0: setReg(X, y); break;
+                case 0x1: setReg(X, x | y); setReg(0xF, splat(0)); break;
+                case 0x2: setReg(X, x & y); setReg(0xF, splat(0)); break;
+                case 0x3: setReg(X, x ^ y); setReg(0xF, splat(0)); break;
+                case 0x4: setReg(X, x + y); setReg(0xF, below(x + y, x) & one); break;
+                case 0x5: setReg(X, x - y); setReg(0xF, ~below(x, y) & one); break;
+                case 0x6: setReg(X, shiftRight(y, 1)); setReg(0xF, y & one); break;
+                case 0x7:
+                    //Like op_8XY7 the flag compares VY with the new VX
+                    setReg(X, y - x);
+                    setReg(0xF, ~below(reg(Y), reg(X)) & one);
+                    break;
+                case 0xE: setReg(X, y + y); setReg(0xF, shiftRight(y, 7)); break;
+            }
+            break;
+        }
+        case 0x9000: skip = ~equal(reg(X), reg(Y)); break;
+        case 0xA000: store(indreg, select(mask16, splat16(NNN), load(indreg))); break;
+        case 0xB000: store(pc, select(mask16, widen(reg(0)) + splat16(NNN), load(pc))); break;
+        case 0xC000:
+        case 0xD000: executeEach(opcode, group); break;
+        case 0xE000:
+            if(NN == 0x9E || NN == 0xA1) executeEach(opcode, group);
+            break;
+        case 0xF000:
+            switch(NN) {
+                case 0x07: setReg(X, load(delay)); break;
+                case 0x15: store(delay, select(mask, reg(X), load(delay))); break;
+                case 0x18: store(soundTimer, select(mask, reg(X), load(soundTimer))); break;
+                case 0x1E: store(indreg, select(mask16, load(indreg) + widen(reg(X)), load(indreg))); break;
+                case 0x29: {
+                    laneWords digit = widen(reg(X));
+                    store(indreg, select(mask16, splat16(0x0050) + shiftLeft(digit, 2) + digit, load(indreg)));
+                    break;
+                }
+                case 0x0A:
+                case 0x33:
+                case 0x55:
+                case 0x65: executeEach(opcode, group); break;
+            }
+            break;
+    }
+    store(pc, load(pc) + (widenMask(skip & mask) & splat16(2)));
+}
+
+// Instructions that touch per-lane memory, the display, the stack or the generator, one lane at a time
+// pc already points past the instruction, as in the scalar engines
+void chip8Lanes::executeEach(uint16_t opcode, uint32_t group) {
+    uint8_t X = (opcode & 0x0F00u) >> 8u;
+    uint8_t Y = (opcode & 0x00F0u) >> 4u;
+    uint8_t NN = opcode & 0x00FFu;
+    switch(opcode & 0xF000) {
+        case 0x0000:
+            if(opcode == 0x00E0) {
+                FOR_EACH_LANE(group)
+                    memset(screens[lane], 0, sizeof(screens[lane]));
+            } else {
+                FOR_EACH_LANE(group) {
+                    stack[sp[lane] & 15u][lane] = 0;
+                    sp[lane]--;
+                    pc[lane] = stack[sp[lane] & 15u][lane];
+                    stack[sp[lane] & 15u][lane] = 0;
+                }
+            }
+            break;
+        case 0x2000:
+            FOR_EACH_LANE(group) {
+                stack[sp[lane] & 15u][lane] = pc[lane];
+                sp[lane]++;
+                pc[lane] = opcode & 0x0FFFu;
+            }
+            break;
+        case 0xC000:
+            FOR_EACH_LANE(group)
+                registers[X][lane] = chip8::nextRandom(rng[lane]) & NN;
+            break;
+        case 0xD000:
+            FOR_EACH_LANE(group) {
+                const uint8_t *mem = laneMemory(lane);
+                uint16_t I = indreg[lane];
+                unsigned Xpos = registers[X][lane] & 63u;
+                unsigned Ypos = registers[Y][lane];
+                bool collision = false;
+                for(unsigned i = 0; i < (opcode & 0xFu); i++) {
+                    uint64_t sprite = rotateRow(uint64_t(mem[(I + i) & 0x0FFFu]) << 56u, Xpos);
+                    uint64_t &row = screens[lane][(Ypos + i) & 31u];
+                    collision |= (row & sprite) != 0;
+                    row ^= sprite;
+                }
+                registers[0xF][lane] = collision ? 1 : 0;
+            }
+            break;
+        case 0xE000: {
+            //EX9E and EXA1, SSE2 and AVX2 have no per-lane 16-bit shift to test the key bit with
+            unsigned skipWhen = NN == 0x9E ? 1u : 0u;
+            FOR_EACH_LANE(group) {
+                if(((keys[lane] >> (registers[X][lane] & 15u)) & 1u) == skipWhen)
+                    pc[lane] += 2;
+            }
+            break;
+        }
+        case 0xF000:
+            switch(NN) {
+                case 0x0A:
+                    FOR_EACH_LANE(group) {
+                        if(keys[lane])
+                            registers[X][lane] = lowestLane(keys[lane]);
+                        else
+                            pc[lane] -= 2;
+                    }
+                    break;
+                case 0x33:
+                    FOR_EACH_LANE(group) {
+                        uint8_t *mem = laneMemory(lane);
+                        uint16_t I = indreg[lane];
+                        uint8_t VX = registers[X][lane];
+                        mem[I & 0x0FFFu] = VX / 100;
+                        mem[(I + 1) & 0x0FFFu] = VX / 10 % 10;
+                        mem[(I + 2) & 0x0FFFu] = VX % 10;
+                        for(int i = 0; i < 3; i++)
+                            written[(I + i) & 0x0FFFu] = 1;
+                    }
+                    break;
+                case 0x55:
+                    FOR_EACH_LANE(group) {
+                        uint8_t *mem = laneMemory(lane);
+                        uint16_t I = indreg[lane];
+                        for(int V = 0; V <= X; V++) {
+                            mem[(I + V) & 0x0FFFu] = registers[V][lane];
+                            written[(I + V) & 0x0FFFu] = 1;
+                        }
+                        indreg[lane] = I + X + 1;
+                    }
+                    break;
+                case 0x65:
+                    FOR_EACH_LANE(group) {
+                        const uint8_t *mem = laneMemory(lane);
+                        uint16_t I = indreg[lane];
+                        for(int V = 0; V <= X; V++)
+                            registers[V][lane] = mem[(I + V) & 0x0FFFu];
+                        indreg[lane] = I + X + 1;
+                    }
+                    break;
+            }
+            break;
+    }
+}
+
+// Execute count instructions on every running lane
+// Timers are not ticked, callers run decrementCounters once per 60 Hz frame
+void chip8Lanes::runCycles(long long count) {
+    if(count <= 0)
+        return;
+    for(long long i = 0; i < count; i++)
+        step();
+    for(uint32_t bits = running; bits; bits &= bits - 1)
+        cycles[lowestLane(bits)] += count;
+}
+
+// Run one 60 Hz frame on every running lane
+void chip8Lanes::runFrame(int instructionsPerFrame) {
+    runCycles(instructionsPerFrame);
+    decrementCounters();
+}
+
+// Decrement the timers of every running lane that are not already zero
+void chip8Lanes::decrementCounters() {
+    laneBytes tick = maskOf(running) & splat(1);
+    laneBytes timer = load(delay);
+    store(delay, timer - (~equal(timer, splat(0)) & tick));
+    timer = load(soundTimer);
+    store(soundTimer, timer - (~equal(timer, splat(0)) & tick));
+}
+
+int chip8Lanes::lanes() const {
+    return laneCount;
+}
+
+// Display of one lane, 32 rows with bit 63 as the leftmost pixel
+const uint64_t *chip8Lanes::getScreen(int lane) const {
+    return screens[lane];
+}
+
+// Same hash as chip8::screenHash
+uint64_t chip8Lanes::screenHash(int lane) const {
+    return chip8::hashScreen(screens[lane]);
+}
+
+const uint8_t *chip8Lanes::getMemory(int lane) const {
+    return memory.get() + size_t(lane) * 4096;
+}
+
+uint16_t chip8Lanes::getPC(int lane) const {
+    return pc[lane];
+}
+
+uint16_t chip8Lanes::getKeys(int lane) const {
+    return keys[lane];
+}
+
+uint64_t chip8Lanes::getCycles(int lane) const {
+    return cycles[lane];
+}
+
+// Groups executed since the ROM was loaded, instructions / groups is the average lanes per vector operation
+uint64_t chip8Lanes::groupsExecuted() const {
+    return groups;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "CHIP8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+using namespace std;
+
+/* Lockstep lane engine
+ * Runs up to MAX_LANES instances of one ROM side by side, for search and reinforcement
+ * learning workloads where every instance plays the same program with different input or
+ * seeds. State is kept as structure-of-arrays: register VX of all lanes is one 32-byte
+ * vector, pc, I, sp, the stack and the timers are vectors too. Each lane keeps its own 4 KB
+ * memory and its display as 32 packed rows, the same layout chip8 uses.
+ *
+ * Every step, each running lane executes exactly one instruction, so running lanes stay on
+ * the same cycle count and timer tick. Lanes are grouped by pc and the group executes
+ * together: ALU, skip, jump, I and timer instructions are whole-vector operations whose
+ * results are blended in under the group's lane mask. When control flow diverges, each
+ * distinct pc becomes its own group in the same step. Calls and returns are vector operations
+ * on one stack row when the group is at a single call depth. DXYN, CXNN, key tests and memory
+ * instructions loop over the lanes of the group.
+ *
+ * Kernels are AVX2 intrinsics when built with -mavx2, SSE2 (two machine vectors per lane
+ * vector) on any other x86-64, and plain loops elsewhere.
+ *
+ * Results are bit-identical to the scalar engines. Only addresses past the end of memory
+ * differ, because lanes wrap them to 4 KB where chip8 reads or writes out of bounds.
+ */
+
+class chip8Lanes {
+public:
+    static constexpr int MAX_LANES{32};
+
+private:
+    alignas(64) uint8_t registers[16][MAX_LANES]{};         //registers[X][lane]
+    alignas(64) uint16_t pc[MAX_LANES]{};
+    alignas(64) uint16_t indreg[MAX_LANES]{};
+    alignas(64) uint16_t stack[16][MAX_LANES]{};
+    alignas(64) uint16_t keys[MAX_LANES]{};                 //Keypad as a mask, bit K = key K
+    alignas(64) uint8_t sp[MAX_LANES]{};
+    alignas(64) uint8_t delay[MAX_LANES]{};
+    alignas(64) uint8_t soundTimer[MAX_LANES]{};
+    alignas(64) uint64_t screens[MAX_LANES][32]{};
+    uint64_t rng[MAX_LANES]{};
+    unique_ptr<uint8_t[]> memory;                           //4 KB per lane
+    uint8_t image[4096]{};                                  //Memory as loaded, shared by every lane until written
+    uint8_t written[4096]{};                                //Set where some lane's memory may differ from image
+    int laneCount;
+    uint32_t running{};                                     //Bit per lane that executes
+    uint64_t cycles[MAX_LANES]{};
+    uint64_t groups{};                                      //Groups executed, for occupancy statistics
+
+    uint8_t *laneMemory(int lane);
+    void step();
+    bool sameDepth(uint32_t group) const;
+    void execute(uint16_t address, uint16_t opcode, uint32_t group);
+    void executeEach(uint16_t opcode, uint32_t group);
+
+public:
+    explicit chip8Lanes(int lanes);
+    bool loadROM(const uint8_t *data, size_t length);
+    void saveState(int lane, chip8State &state) const;
+    bool loadState(int lane, const chip8State &state);
+    void setSeed(int lane, uint32_t seed);
+    void setKeys(int lane, uint16_t mask);
+    void setRunning(int lane, bool on);
+    bool isRunning(int lane) const;
+    void runCycles(long long count);
+    void runFrame(int instructionsPerFrame);
+    void decrementCounters();
+
+    int lanes() const;
+    const uint64_t *getScreen(int lane) const;
+    uint64_t screenHash(int lane) const;
+    const uint8_t *getMemory(int lane) const;
+    uint16_t getPC(int lane) const;
+    uint16_t getKeys(int lane) const;
+    uint64_t getCycles(int lane) const;
+    uint64_t groupsExecuted() const;
+};
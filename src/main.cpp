@@ -1,48 +1,248 @@
 #define SDL_MAIN_HANDLED
 #include "CHIP8.hpp"
-#include <chrono> 
+#include "graphics.hpp"
+#include "emuthread.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 using namespace std;
-using namespace chrono_literals;
 
+static const int DEFAULT_IPF{11};
+static const int DEFAULT_REWIND_SECONDS{60};
+static const Uint64 LATENCY_TIMEOUT_NS{500000000};     //Presses with no visible reaction by then are not traced
+
+//A key press waiting for the first presented frame emulated with it
+struct pendingPress {
+    uint64_t sequence;
+    Uint64 timestamp;                                   //SDL event time in ns
+};
+
+// Handle one SDL event, returns false when the window was closed
+// Key presses are queued in presses for latency tracing when it is not null
+static bool handleEvent(const SDL_Event &event, uint8_t *keypad, emulationThread &emulation, Graphics &display,
+                        deque<pendingPress> *presses) {
+    if(event.type == SDL_EVENT_QUIT) 
+        return false;
+    if(event.type == SDL_EVENT_WINDOW_EXPOSED) 
+        display.invalidate();
+    if(event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) {
+        if(event.key.scancode == SDL_SCANCODE_BACKSPACE) 
+            emulation.setRewinding(event.type == SDL_EVENT_KEY_DOWN);
+        if(event.key.scancode == SDL_SCANCODE_TAB && event.type == SDL_EVENT_KEY_DOWN && !event.key.repeat) 
+            emulation.setTurbo(!emulation.turboActive());
+        if(display.inputBuffer(keypad, event)) {
+            uint64_t sequence = emulation.setKeys(keypad);
+            if(presses && event.type == SDL_EVENT_KEY_DOWN) 
+                presses->push_back({sequence, event.key.timestamp});
+        }
+    }
+    return true;
+}
 
 // Main loop for the game 
-// Infinite loop keeps window open
+// The emulation thread runs each 60 Hz frame (a fixed budget of instructions and one timer tick)
+// and wakes this thread with an event; this thread only handles input and draws the newest frame
+// Holding Backspace rewinds one frame per 60 Hz tick
+// Tab toggles turbo: --turbo-speed N times 60 Hz (0, the default, is uncapped), presenting every --frameskip K-th frame
+// (0, the default, presents at 60 Hz) with the beep muted; --turbo starts in turbo
+// --record writes an input log that chip8-headless --replay re-runs bit-exactly
+// --telemetry writes counters and frame timings as JSON on exit, and every --telemetry-interval seconds, including
+// the time from each key press to the first presented frame that was emulated with it and the queued audio latency
+// --keymap loads the scancode to CHIP-8 key table from a file
+// --mode runs SUPER-CHIP or XO-CHIP programs: 128x64 display, scrolling, and for XO-CHIP two bitplanes and pattern audio
+// --quirks picks the compatibility profile of the platform the ROM was written for
+// --palette picks the display colours, a name or RRGGBB colours for off, plane 1, plane 2 and both planes
+// --persistence F lets unlit pixels keep the fraction F (below 1) of their brightness each frame, hiding sprite flicker
+// Usage: chip8 <rom> [--ipf N] [--engine interp|predecoded|jit] [--vsync] [--rewind SECONDS] [--seed N] [--record FILE]
+//                    [--telemetry FILE] [--telemetry-interval SECONDS] [--turbo] [--turbo-speed N] [--frameskip K]
+//                    [--keymap FILE] [--mode chip8|schip|xochip] [--quirks default|vip|chip48|schip|xochip]
+//                    [--palette default|mono|green|amber|lcd|RRGGBB,RRGGBB[,RRGGBB,RRGGBB]] [--persistence F]
 int main(int argc, char *argv[]) {
+    const char *romPath = NULL;
+    bool vsync = false;
+    int ipf = DEFAULT_IPF;
+    int rewindSeconds = DEFAULT_REWIND_SECONDS;
+    Engine engine = Engine::Interpreter;
+    Mode mode = Mode::Chip8;
+    Quirks quirks = Quirks::Default;
+    const char *recordPath = NULL;
+    const char *telemetryPath = NULL;
+    const char *keyMapPath = NULL;
+    double telemetryInterval = 0;
+    bool seeded = false;
+    uint32_t seed = 0;
+    bool turbo = false;
+    int turboSpeed = 0;
+    int frameSkip = 0;
+    palette colours = DEFAULT_PALETTE;
+    float persistence = 0;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--vsync")) vsync = true;
+        else if(!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 0);
+            seeded = true;
+        }
+        else if(!strcmp(argv[i], "--record") && i + 1 < argc) recordPath = argv[++i];
+        else if(!strcmp(argv[i], "--telemetry") && i + 1 < argc) telemetryPath = argv[++i];
+        else if(!strcmp(argv[i], "--keymap") && i + 1 < argc) keyMapPath = argv[++i];
+        else if(!strcmp(argv[i], "--telemetry-interval") && i + 1 < argc) telemetryInterval = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--ipf") && i + 1 < argc) ipf = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--rewind") && i + 1 < argc) rewindSeconds = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--turbo")) turbo = true;
+        else if(!strcmp(argv[i], "--turbo-speed") && i + 1 < argc) turboSpeed = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--frameskip") && i + 1 < argc) frameSkip = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--engine") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "predecoded")) engine = Engine::Predecoded;
+            else if(!strcmp(name, "jit")) engine = Engine::Jit;
+        }
+        else if(!strcmp(argv[i], "--mode") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "schip")) mode = Mode::SuperChip;
+            else if(!strcmp(name, "xochip")) mode = Mode::XoChip;
+        }
+        else if(!strcmp(argv[i], "--quirks") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "default")) quirks = Quirks::Default;
+            else if(!strcmp(name, "vip")) quirks = Quirks::Vip;
+            else if(!strcmp(name, "chip48")) quirks = Quirks::Chip48;
+            else if(!strcmp(name, "schip")) quirks = Quirks::SuperChip;
+            else if(!strcmp(name, "xochip")) quirks = Quirks::XoChip;
+        }
+        else if(!strcmp(argv[i], "--palette") && i + 1 < argc) {
+            if(!parsePalette(argv[++i], colours))
+                return 1;
+        }
+        else if(!strcmp(argv[i], "--persistence") && i + 1 < argc) persistence = atof(argv[++i]);
+        else romPath = argv[i];
+    }
+    if(!romPath || ipf <= 0 || turboSpeed < 0 || frameSkip < 0 || persistence < 0 || persistence >= 1) {
+        cerr << "Usage: " << argv[0] << " <rom> [--ipf N] [--engine interp|predecoded|jit] [--vsync] [--rewind SECONDS] [--seed N] [--record FILE] [--telemetry FILE] [--telemetry-interval SECONDS] [--turbo] [--turbo-speed N] [--frameskip K] [--keymap FILE] [--mode chip8|schip|xochip] [--quirks PROFILE] [--palette PALETTE] [--persistence F]" << endl;
+        return 1;
+    }
+
     chip8 emulator; 
-    emulator.loadROM(argv[1]); 
+    emulator.setMode(mode);
+    if(!emulator.loadROM(romPath)) 
+        return 1;
+    emulator.setEngine(engine);
+    emulator.setQuirks(quirks);
+    if(!seeded) 
+        seed = random_device()();
+    emulator.setSeed(seed);
+    inputLog recording;
+    recording.begin(emulator, seed, ipf);
+    unique_ptr<telemetry> stats;
+    if(telemetryPath) 
+        stats.reset(new telemetry(telemetryPath, telemetryInterval));
+    Graphics display; 
+    if(keyMapPath && !display.loadKeyMap(keyMapPath)) 
+        return 1;
+    display.setVSync(vsync);
+    display.setPalette(colours);
+    display.setPersistence(persistence);
+    display.setTelemetry(stats.get());
+    Uint32 frameEvent = SDL_RegisterEvents(1);
+    atomic<bool> wakePending{false};
+    emulationThread emulation(emulator, ipf, rewindSeconds);
+    if(recordPath) 
+        emulation.setRecording(&recording);
+    emulation.setTelemetry(stats.get());
+    emulation.setTurboSpeed(turboSpeed, frameSkip);
+    emulation.setTurbo(turbo);
+    uint8_t keypad[16] = {0};
+    uint64_t shownScreen[32];
+    uint64_t shownPlanes[2][64][2];
+    bool firstFrame = true;
     SDL_Event event; 
     bool quit = false; 
-    auto previousTime = chrono::high_resolution_clock::now(); 
-    auto IPSCounter = chrono::high_resolution_clock::now();
+    bool beeping = false; 
+    deque<pendingPress> presses;
+    deque<pendingPress> *tracing = stats ? &presses : NULL;
+
+// The emulation thread posts at most one wake-up event at a time
+    emulation.start([frameEvent, &wakePending] {
+        if(frameEvent == 0 || wakePending.exchange(true))
+            return;
+        SDL_Event wake;
+        SDL_zero(wake);
+        wake.type = frameEvent;
+        SDL_PushEvent(&wake);
+    });
 
 // Infinite loop to keep game open, checks for exit
     while(!quit) {
-        while(SDL_PollEvent(&event) != 0) {
-            if(event.type == SDL_EVENT_QUIT) {
-                quit = true; 
-                break;
+        if(SDL_WaitEventTimeout(&event, frameEvent ? -1 : 16)) {
+            if(event.type == frameEvent)
+                wakePending = false;
+            quit = !handleEvent(event, keypad, emulation, display, tracing);
+            while(!quit && SDL_PollEvent(&event)) {
+                if(event.type == frameEvent)
+                    wakePending = false;
+                quit = !handleEvent(event, keypad, emulation, display, tracing);
             }
-            emulator.inputBuffer(event);
-        } 
-        auto currentTime = chrono::high_resolution_clock::now(); 
-        auto currentIPS = chrono::high_resolution_clock::now(); 
-        chrono::duration<float, milli> deltaTime = currentTime - previousTime;
-        chrono::duration<float, milli> deltaIPSTime = currentIPS - IPSCounter;
-
-        if(deltaIPSTime > 1.5ms) {
-            IPSCounter = currentIPS;
-            emulator.emulateCycle();
-            emulator.updateDisplay();
-        }
-        emulator.generateAudio();
-        emulator.playSound();
-        
-        if(deltaTime > 16.67ms) {
-            previousTime = currentTime;
-            emulator.decrementCounters();
         }
+
+// Draw only the newest frame, rows are uploaded when they differ from what is on screen
+        if(!quit && emulation.fetchFrame()) {
+            auto renderStart = stats ? chrono::steady_clock::now() : chrono::steady_clock::time_point{};
+            const frameSnapshot &frame = emulation.latestFrame();
+            if(frame.extended) {
+                uint64_t dirtyRows = 0;
+                for(int i = 0; i < 64; i++) {
+                    if(firstFrame || frame.planes[0][i][0] != shownPlanes[0][i][0] || frame.planes[0][i][1] != shownPlanes[0][i][1]
+                       || frame.planes[1][i][0] != shownPlanes[1][i][0] || frame.planes[1][i][1] != shownPlanes[1][i][1]) 
+                        dirtyRows |= uint64_t(1) << i;
+                }
+                memcpy(shownPlanes, frame.planes, sizeof(shownPlanes));
+                display.updateExtendedDisplay(frame.planes, dirtyRows);
+            }
+            else {
+                uint32_t dirtyRows = 0;
+                for(int i = 0; i < 32; i++) {
+                    if(firstFrame || frame.screen[i] != shownScreen[i]) 
+                        dirtyRows |= 1u << i;
+                }
+                memcpy(shownScreen, frame.screen, sizeof(shownScreen));
+                display.updateDisplay(frame.screen, dirtyRows);
+            }
+            firstFrame = false;
+            if(frame.sound != beeping) {
+                beeping = frame.sound;
+                display.setBeep(beeping);
+            }
+            display.setAudioPattern(frame.hasPattern ? frame.pattern : NULL, frame.pitch);
+            bool presented = display.updateScreen(frame.registers, frame.stack, frame.pc);
+            if(stats) {
+                stats->recordRender(chrono::steady_clock::now() - renderStart);
+                stats->recordAudioLatency(chrono::nanoseconds(int64_t(display.audioLatencyMs() * 1e6f)));
+            }
+
+// A press reached the screen with the first presented frame emulated after it
+            if(stats && presented) {
+                Uint64 now = SDL_GetTicksNS();
+                while(!presses.empty() && presses.front().sequence <= frame.inputSequence) {
+                    Uint64 latency = now - presses.front().timestamp;
+                    if(latency <= LATENCY_TIMEOUT_NS) 
+                        stats->recordInputLatency(chrono::nanoseconds(latency));
+                    presses.pop_front();
+                }
+            }
+        }
+    }
+    emulation.stop();
+    display.setTelemetry(NULL);
+    if(stats && !stats->writeJson()) 
+        return 1;
+    if(recordPath) {
+        recording.endCycle = emulator.getCycles();
+        if(!recording.save(recordPath)) 
+            return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,259 @@
+#include "pixels.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+//Named palettes for --palette
+static const struct {
+    const char *name;
+    palette colours;
+} PALETTES[] = {
+    {"default", DEFAULT_PALETTE},
+    {"mono", {{0x000000FFu, 0xFFFFFFFFu, 0xAAAAAAFFu, 0x555555FFu}}},
+    {"green", {{0x0A140AFFu, 0x33FF66FFu, 0x1A8033FFu, 0xCCFFCCFFu}}},
+    {"amber", {{0x140A00FFu, 0xFFB000FFu, 0x805800FFu, 0xFFE0A0FFu}}},
+    {"lcd", {{0x9BBC0FFFu, 0x0F380FFFu, 0x8BAC0FFFu, 0x306230FFu}}},
+};
+
+//Each bit of a byte widened to a whole byte, most significant bit first in memory order
+static uint64_t BYTE_MASKS[256];
+
+// Read a palette: a name (default, mono, green, amber, lcd) or 2 to 4 comma separated RRGGBB colours
+// in the order off, plane 1, plane 2, both planes; missing plane colours keep the default ones
+bool parsePalette(const char *text, palette &out) {
+    for(const auto &named : PALETTES) {
+        if(!strcmp(text, named.name)) {
+            out = named.colours;
+            return true;
+        }
+    }
+    palette parsed = DEFAULT_PALETTE;
+    int count = 0;
+    for(const char *field = text; count < 4; count++) {
+        //Exactly six hex digits, strtoul alone would also take signs, spaces and a 0x prefix
+        int digits = 0;
+        while(digits < 6 && isxdigit((unsigned char)field[digits]))
+            digits++;
+        const char *end = field + digits;
+        if(digits != 6 || (*end != ',' && *end != '\0')) {
+            cerr << "Palette must be a name or 2 to 4 RRGGBB colours!" << endl;
+            return false;
+        }
+        unsigned long rgb = strtoul(field, NULL, 16);
+        parsed.colours[count] = uint32_t(rgb << 8) | 0xFFu;
+        if(*end == '\0') {
+            count++;
+            break;
+        }
+        field = end + 1;
+    }
+    if(count < 2) {
+        cerr << "Palette must be a name or 2 to 4 RRGGBB colours!" << endl;
+        return false;
+    }
+    out = parsed;
+    return true;
+}
+
+// Mix two RGBA8888 colours, weight 0 gives a and 255 gives b
+static uint32_t mix(uint32_t a, uint32_t b, unsigned weight) {
+    uint32_t colour = 0;
+    for(int shift = 0; shift < 32; shift += 8) {
+        unsigned from = (a >> shift) & 0xFFu, to = (b >> shift) & 0xFFu;
+        colour |= ((from * (255 - weight) + to * weight + 127) / 255) << shift;
+    }
+    return colour;
+}
+
+// Start with the default palette and no persistence, the shared bit masks are built by the first pipeline
+pixelPipeline::pixelPipeline() {
+    static const bool masksBuilt = [] {
+        for(int value = 0; value < 256; value++) {
+            uint64_t mask = 0;
+            for(int bit = 0; bit < 8; bit++) {
+                if(value & (0x80 >> bit))
+                    mask |= uint64_t(0xFF) << (8 * bit);
+            }
+            BYTE_MASKS[value] = mask;
+        }
+        return true;
+    }();
+    (void)masksBuilt;
+    buildTables();
+}
+
+// Rebuild the expansion table and brightness ramps from the palette
+void pixelPipeline::buildTables() {
+    for(int value = 0; value < 256; value++) {
+        for(int bit = 0; bit < 8; bit++)
+            byteColours[value][bit] = colours.colours[(value >> (7 - bit)) & 1];
+        ramp[value] = mix(colours.colours[0], colours.colours[1], value);
+        unsigned plane1 = (value & 0x0F) * 17, plane2 = (value >> 4) * 17;
+        planeRamp[value] = mix(mix(colours.colours[0], colours.colours[1], plane1),
+                               mix(colours.colours[2], colours.colours[3], plane1), plane2);
+    }
+}
+
+// Select the colours, the caller redraws every row afterwards
+void pixelPipeline::setPalette(const palette &colours) {
+    this->colours = colours;
+    buildTables();
+}
+
+// Return the colours in use
+const palette &pixelPipeline::getPalette() const {
+    return colours;
+}
+
+// Fraction of its brightness an unlit pixel keeps each frame, 0 turns persistence off
+// Values are capped below 1 so every pixel fades out completely
+void pixelPipeline::setPersistence(float kept) {
+    decay = uint16_t(min(max(kept, 0.0f), 0.99f) * 256);
+    memset(brightness, 0, sizeof(brightness));
+    fading = 0;
+    planesFading = 0;
+}
+
+// Classic rows that change on the next frame even if their pixels do not, OR them into the dirty rows
+uint32_t pixelPipeline::fadingRows() const {
+    return fading;
+}
+
+// Extended rows that change on the next frame even if their pixels do not
+uint64_t pixelPipeline::fadingPlaneRows() const {
+    return planesFading;
+}
+
+// Bytes of a packed row in screen order, leftmost pixel in the most significant bit of the first byte
+static inline void rowBytes(const uint64_t *words, int wordCount, uint8_t *bytes) {
+    for(int w = 0; w < wordCount; w++) {
+        for(int k = 0; k < 8; k++)
+            bytes[8 * w + k] = uint8_t(words[w] >> (56 - 8 * k));
+    }
+}
+
+// One frame of persistence for count pixels (a multiple of 32): lit pixels go to full brightness,
+// the others keep decay/256 of theirs. Returns true while an unlit pixel is still glowing
+static bool decayRun(uint8_t *level, const uint8_t *bits, int count, uint16_t decay) {
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256(), factor = _mm256_set1_epi16(short(decay));
+    __m256i glowing = zero;
+    for(int x = 0; x < count; x += 32) {
+        const uint8_t *b = bits + x / 8;
+        __m256i lit = _mm256_set_epi64x(BYTE_MASKS[b[3]], BYTE_MASKS[b[2]], BYTE_MASKS[b[1]], BYTE_MASKS[b[0]]);
+        __m256i now = _mm256_loadu_si256((const __m256i*)(level + x));
+        __m256i low = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(now, zero), factor), 8);
+        __m256i high = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(now, zero), factor), 8);
+        now = _mm256_max_epu8(_mm256_packus_epi16(low, high), lit);
+        _mm256_storeu_si256((__m256i*)(level + x), now);
+        glowing = _mm256_or_si256(glowing, _mm256_andnot_si256(lit, now));
+    }
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(glowing, zero)) != -1;
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128(), factor = _mm_set1_epi16(short(decay));
+    __m128i glowing = zero;
+    for(int x = 0; x < count; x += 16) {
+        const uint8_t *b = bits + x / 8;
+        __m128i lit = _mm_set_epi64x(BYTE_MASKS[b[1]], BYTE_MASKS[b[0]]);
+        __m128i now = _mm_loadu_si128((const __m128i*)(level + x));
+        __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(now, zero), factor), 8);
+        __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(now, zero), factor), 8);
+        now = _mm_max_epu8(_mm_packus_epi16(low, high), lit);
+        _mm_storeu_si128((__m128i*)(level + x), now);
+        glowing = _mm_or_si128(glowing, _mm_andnot_si128(lit, now));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(glowing, zero)) != 0xFFFF;
+#else
+    bool glowing = false;
+    for(int x = 0; x < count; x++) {
+        bool lit = (bits[x / 8] >> (7 - x % 8)) & 1u;
+        level[x] = lit ? 255 : uint8_t((level[x] * decay) >> 8);
+        glowing |= !lit && level[x];
+    }
+    return glowing;
+#endif
+}
+
+// Look up count colours of a ramp, 8 per gather with AVX2
+static inline void rampRun(const uint32_t *ramp, const uint8_t *index, int count, uint32_t *out) {
+#if defined(__AVX2__)
+    for(int x = 0; x < count; x += 8) {
+        __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(index + x)));
+        _mm256_storeu_si256((__m256i*)(out + x), _mm256_i32gather_epi32((const int*)ramp, lanes, 4));
+    }
+#else
+    for(int x = 0; x < count; x++)
+        out[x] = ramp[index[x]];
+#endif
+}
+
+// Convert rows [first, first + count) of the 64x32 display, row i is written at pixels + pitch * (i - first)
+void pixelPipeline::expandRows(const uint64_t *screen, int first, int count, uint8_t *pixels, int pitch) {
+    for(int i = 0; i < count; i++) {
+        int row = first + i;
+        uint8_t bits[8];
+        rowBytes(&screen[row], 1, bits);
+        uint32_t *out = reinterpret_cast<uint32_t*>(pixels + pitch * i);
+        if(!decay) {
+            for(int k = 0; k < 8; k++)
+                memcpy(out + 8 * k, byteColours[bits[k]], sizeof(byteColours[0]));
+            continue;
+        }
+        uint8_t *level = brightness[0][row];
+        if(decayRun(level, bits, 64, decay))
+            fading |= 1u << row;
+        else
+            fading &= ~(1u << row);
+        rampRun(ramp, level, 64, out);
+    }
+}
+
+// Convert rows [first, first + count) of the 128x64 extended display
+void pixelPipeline::expandPlaneRows(const uint64_t planes[2][64][2], int first, int count, uint8_t *pixels, int pitch) {
+    for(int i = 0; i < count; i++) {
+        int row = first + i;
+        uint8_t bits[2][16];
+        rowBytes(planes[0][row], 2, bits[0]);
+        rowBytes(planes[1][row], 2, bits[1]);
+        uint32_t *out = reinterpret_cast<uint32_t*>(pixels + pitch * i);
+        uint8_t index[128];
+        if(!decay) {
+            for(int x = 0; x < 128; x++) {
+                int shift = 7 - (x & 7);
+                index[x] = (((bits[0][x >> 3] >> shift) & 1u) ? 0x0F : 0) | (((bits[1][x >> 3] >> shift) & 1u) ? 0xF0 : 0);
+            }
+            rampRun(planeRamp, index, 128, out);
+            continue;
+        }
+        bool glowing = decayRun(brightness[0][row], bits[0], 128, decay);
+        glowing |= decayRun(brightness[1][row], bits[1], 128, decay);
+        if(glowing)
+            planesFading |= uint64_t(1) << row;
+        else
+            planesFading &= ~(uint64_t(1) << row);
+        for(int x = 0; x < 128; x++)
+            index[x] = (brightness[0][row][x] >> 4) | (brightness[1][row][x] & 0xF0);
+        rampRun(planeRamp, index, 128, out);
+    }
+}
+
+// Enlarge a width x height image by an integer factor with square pixels, for frame dumps
+// Each source row is widened once and then copied factor - 1 times
+void pixelPipeline::scale(const uint32_t *pixels, int width, int height, int factor, vector<uint32_t> &out) {
+    size_t scaledWidth = size_t(width) * factor;
+    out.resize(scaledWidth * height * factor);
+    for(int y = 0; y < height; y++) {
+        uint32_t *line = out.data() + scaledWidth * factor * y;
+        for(int x = 0; x < width; x++)
+            fill_n(line + size_t(x) * factor, factor, pixels[size_t(width) * y + x]);
+        for(int copy = 1; copy < factor; copy++)
+            memcpy(line + scaledWidth * copy, line, scaledWidth * sizeof(uint32_t));
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+/* Pixel pipeline
+ * Turns the packed 1-bit rows of the core into RGBA8888 pixels (0xRRGGBBAA words, the SDL
+ * texture format), for the SDL window and for headless frame dumps alike; there is no SDL here.
+ *
+ * Without persistence a byte of pixels is expanded to 8 colours with one table lookup.
+ * With persistence every pixel keeps a brightness that jumps to full when it is lit and otherwise
+ * decays by a fixed fraction per frame, so sprites that a game erases and redraws on alternate
+ * frames stay visible instead of flickering. The brightness update runs 16 (SSE2) or 32 (AVX2)
+ * pixels per step, and brightness is turned into a colour through a ramp between the palette
+ * colours. Rows are only converted when the caller marks them dirty, or while they are fading.
+ */
+
+//Colours of the four pixel values: off, plane 1, plane 2 and both planes (the classic display uses the first two)
+struct palette {
+    uint32_t colours[4];
+};
+
+//The colours the window has always used
+static const palette DEFAULT_PALETTE{{0x191919FFu, 0xFFC800FFu, 0x00A0FFFFu, 0xFFFFFFFFu}};
+
+bool parsePalette(const char *text, palette &out);
+
+class pixelPipeline {
+    palette colours{DEFAULT_PALETTE};
+    uint16_t decay{};                       //Brightness kept per frame in 1/256ths, 0 without persistence
+    uint32_t byteColours[256][8];           //Byte of classic pixels, most significant bit first, to 8 colours
+    uint32_t ramp[256];                     //Classic colour at each brightness
+    uint32_t planeRamp[256];                //Extended colour, plane 1 brightness in the low nibble, plane 2 in the high one
+    uint8_t brightness[2][64][128]{};       //[plane][row][pixel], the classic display uses plane 0 and 64x32
+    uint32_t fading{};                      //Classic rows with pixels still fading out
+    uint64_t planesFading{};                //Extended rows with pixels still fading out
+    void buildTables();
+
+public:
+    pixelPipeline();
+    void setPalette(const palette &colours);
+    const palette &getPalette() const;
+    void setPersistence(float kept);
+    uint32_t fadingRows() const;
+    uint64_t fadingPlaneRows() const;
+    void expandRows(const uint64_t *screen, int first, int count, uint8_t *pixels, int pitch);
+    void expandPlaneRows(const uint64_t planes[2][64][2], int first, int count, uint8_t *pixels, int pitch);
+
+    static void scale(const uint32_t *pixels, int width, int height, int factor, vector<uint32_t> &out);
+};
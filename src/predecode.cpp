@@ -0,0 +1,292 @@
+#include "CHIP8.hpp"
+using namespace std;
+
+/* Pre-decoded engine
+ * Every 2-byte slot of memory is decoded once into a decodedOp holding its handler and the
+ * X, Y, NN and NNN operands. Entries start out pointing at the decode handler and are filled
+ * in on their first execution. With GNU C the handler is a label address and each handler
+ * jumps straight to the next one (direct threading), other compilers fall back to a switch.
+ *
+ * Writes into memory (op_FX33, op_FX55) invalidate only the entries covering the written bytes.
+ * Rarely used or stateful instructions call the reference op_* methods.
+ */
+
+#define PREDECODED_OPS(OP) \
+    OP(DECODE) OP(FALLBACK) OP(00E0) OP(00EE) OP(1NNN) OP(2NNN) OP(3XNN) OP(4XNN) OP(5XY0) \
+    OP(6XNN) OP(7XNN) OP(8XY0) OP(8XY1) OP(8XY2) OP(8XY3) OP(8XY4) OP(8XY5) OP(8XY6) OP(8XY7) \
+    OP(8XYE) OP(9XY0) OP(ANNN) OP(BNNN) OP(CXNN) OP(DXYN) OP(EX9E) OP(EXA1) OP(FX07) OP(FX0A) \
+    OP(FX15) OP(FX18) OP(FX1E) OP(FX29) OP(FX33) OP(FX55) OP(FX65)
+
+#define OP_ENUM(name) OP_##name,
+enum : uint8_t { PREDECODED_OPS(OP_ENUM) };
+#undef OP_ENUM
+
+// Map an opcode to its handler number, mirrors the switch in chip8::decodeExe
+// Anything decodeExe handles without a fast path here goes to FALLBACK
+static uint8_t decodeHandlerFor(uint16_t opcode) {
+    switch(opcode & 0xF000) {
+        case 0x0000:
+            if(opcode == 0x00E0) return OP_00E0;
+            if(opcode == 0x00EE) return OP_00EE;
+            return OP_FALLBACK;
+        case 0x1000: return OP_1NNN;
+        case 0x2000: return OP_2NNN;
+        case 0x3000: return OP_3XNN;
+        case 0x4000: return OP_4XNN;
+        case 0x5000: return OP_5XY0;
+        case 0x6000: return OP_6XNN;
+        case 0x7000: return OP_7XNN;
+        case 0x8000:
+            switch(opcode & 0x000F) {
+                case 0x0: return OP_8XY0;
+                case 0x1: return OP_8XY1;
+                case 0x2: return OP_8XY2;
+                case 0x3: return OP_8XY3;
+                case 0x4: return OP_8XY4;
+                case 0x5: return OP_8XY5;
+                case 0x6: return OP_8XY6;
+                case 0x7: return OP_8XY7;
+                case 0xE: return OP_8XYE;
+            }
+            return OP_FALLBACK;
+        case 0x9000: return OP_9XY0;
+        case 0xA000: return OP_ANNN;
+        case 0xB000: return OP_BNNN;
+        case 0xC000: return OP_CXNN;
+        case 0xD000: return OP_DXYN;
+        case 0xE000:
+            if((opcode & 0x00FF) == 0x9E) return OP_EX9E;
+            if((opcode & 0x00FF) == 0xA1) return OP_EXA1;
+            return OP_FALLBACK;
+        case 0xF000:
+            switch(opcode & 0x00FF) {
+                case 0x07: return OP_FX07;
+                case 0x0A: return OP_FX0A;
+                case 0x15: return OP_FX15;
+                case 0x18: return OP_FX18;
+                case 0x1E: return OP_FX1E;
+                case 0x29: return OP_FX29;
+                case 0x33: return OP_FX33;
+                case 0x55: return OP_FX55;
+                case 0x65: return OP_FX65;
+            }
+    }
+    return OP_FALLBACK;
+}
+
+#if defined(__GNUC__)
+#define HANDLER(name) L_##name:
+#define NEXT() \
+    if(--count == 0) return; \
+    entry = &decodeCache[pc & 0x0FFFu]; \
+    pc += 2; \
+    goto *entry->handler
+#define REDISPATCH() goto *entry->handler
+#else
+#define HANDLER(name) case OP_##name:
+#define NEXT() break
+#define REDISPATCH() pc -= 2; continue
+#endif
+
+// Run count instructions through the decode cache
+void chip8::runPredecoded(long long count) {
+    if(count <= 0)
+        return;
+#if defined(__GNUC__)
+#define OP_LABEL(name) &&L_##name,
+    static const void *const handlers[] = { PREDECODED_OPS(OP_LABEL) };
+#undef OP_LABEL
+    decodeHandler = handlers[OP_DECODE];
+#endif
+    if(!decodeCache) {
+        decodeCache.reset(new decodedOp[4096]);
+        flushDecodeCache();
+    }
+    decodedOp *entry = &decodeCache[pc & 0x0FFFu];
+    pc += 2;
+
+#if defined(__GNUC__)
+    goto *entry->handler;
+#else
+    for(;; entry = &decodeCache[pc & 0x0FFFu], pc += 2) {
+    switch(entry->op) {
+#endif
+
+    HANDLER(DECODE) {
+        uint16_t address = (pc - 2) & 0x0FFFu;
+        uint16_t op = (memory[address] << 8u) | memory[(address + 1) & 0x0FFFu];
+        entry->opcode = op;
+        entry->NNN = op & 0x0FFFu;
+        entry->X = (op & 0x0F00u) >> 8u;
+        entry->Y = (op & 0x00F0u) >> 4u;
+        entry->NN = op & 0x00FFu;
+        entry->op = decodeHandlerFor(op);
+#if defined(__GNUC__)
+        entry->handler = handlers[entry->op];
+#endif
+        REDISPATCH();
+    }
+    HANDLER(FALLBACK)
+        opcode = entry->opcode;
+        decodeExe(opcode);
+        NEXT();
+    HANDLER(00E0)
+        op_00E0();
+        NEXT();
+    HANDLER(00EE)
+        stack[sp] = 0;
+        pc = stack[--sp];
+        stack[sp] = 0;
+        NEXT();
+    HANDLER(1NNN)
+        pc = entry->NNN;
+        NEXT();
+    HANDLER(2NNN)
+        stack[sp] = pc;
+        ++sp;
+        pc = entry->NNN;
+        NEXT();
+    HANDLER(3XNN)
+        if(registers[entry->X] == entry->NN) pc += 2;
+        NEXT();
+    HANDLER(4XNN)
+        if(registers[entry->X] != entry->NN) pc += 2;
+        NEXT();
+    HANDLER(5XY0)
+        if(registers[entry->X] == registers[entry->Y]) pc += 2;
+        NEXT();
+    HANDLER(6XNN)
+        registers[entry->X] = entry->NN;
+        NEXT();
+    HANDLER(7XNN)
+        registers[entry->X] += entry->NN;
+        NEXT();
+    HANDLER(8XY0)
+        registers[entry->X] = registers[entry->Y];
+        NEXT();
+    HANDLER(8XY1)
+        registers[entry->X] |= registers[entry->Y];
+        registers[0xF] = 0;
+        NEXT();
+    HANDLER(8XY2)
+        registers[entry->X] &= registers[entry->Y];
+        registers[0xF] = 0;
+        NEXT();
+    HANDLER(8XY3)
+        registers[entry->X] ^= registers[entry->Y];
+        registers[0xF] = 0;
+        NEXT();
+    HANDLER(8XY4) {
+        uint16_t sum = registers[entry->Y] + registers[entry->X];
+        registers[entry->X] = sum & 0x00FFu;
+        registers[0xF] = (sum > 255) ? 1 : 0;
+        NEXT();
+    }
+    HANDLER(8XY5) {
+        bool borrow = registers[entry->X] < registers[entry->Y];
+        registers[entry->X] = registers[entry->X] - registers[entry->Y];
+        registers[0xF] = (borrow) ? 0 : 1;
+        NEXT();
+    }
+    HANDLER(8XY6) {
+        uint8_t VY = registers[entry->Y];
+        registers[entry->X] = VY >> 1u;
+        registers[0xF] = VY & 0x01;
+        NEXT();
+    }
+    HANDLER(8XY7)
+        registers[entry->X] = registers[entry->Y] - registers[entry->X];
+        registers[0xF] = (registers[entry->Y] < registers[entry->X]) ? 0 : 1;
+        NEXT();
+    HANDLER(8XYE) {
+        uint8_t VY = registers[entry->Y];
+        registers[entry->X] = VY << 1u;
+        registers[0xF] = (VY & 0x80) >> 7u;
+        NEXT();
+    }
+    HANDLER(9XY0)
+        if(registers[entry->X] != registers[entry->Y]) pc += 2;
+        NEXT();
+    HANDLER(ANNN)
+        indreg = entry->NNN;
+        NEXT();
+    HANDLER(BNNN)
+        pc = registers[0x0] + entry->NNN;
+        NEXT();
+    HANDLER(CXNN)
+        opcode = entry->opcode;
+        op_CXNN();
+        NEXT();
+    HANDLER(DXYN)
+        opcode = entry->opcode;
+        op_DXYN<Quirks::Default>();
+        NEXT();
+    HANDLER(EX9E)
+        if(keypad[registers[entry->X]]) pc += 2;
+        NEXT();
+    HANDLER(EXA1)
+        if(!keypad[registers[entry->X]]) pc += 2;
+        NEXT();
+    HANDLER(FX07)
+        registers[entry->X] = delay;
+        NEXT();
+    HANDLER(FX0A)
+        opcode = entry->opcode;
+        op_FX0A();
+        NEXT();
+    HANDLER(FX15)
+        delay = registers[entry->X];
+        NEXT();
+    HANDLER(FX18)
+        soundTimer = registers[entry->X];
+        NEXT();
+    HANDLER(FX1E)
+        indreg += registers[entry->X];
+        NEXT();
+    HANDLER(FX29)
+        indreg = 0x0050 + registers[entry->X] * 5;
+        NEXT();
+    HANDLER(FX33)
+        opcode = entry->opcode;
+        op_FX33();
+        NEXT();
+    HANDLER(FX55)
+        opcode = entry->opcode;
+        op_FX55<Quirks::Default>();
+        NEXT();
+    HANDLER(FX65)
+        opcode = entry->opcode;
+        op_FX65<Quirks::Default>();
+        NEXT();
+
+#if !defined(__GNUC__)
+    }
+    if(--count == 0)
+        return;
+    }
+#endif
+}
+
+#undef HANDLER
+#undef NEXT
+#undef REDISPATCH
+
+// Reset the cache entries that cover bytes [address, address + length)
+// The entry one byte before address is included since an instruction spans two bytes
+void chip8::invalidateDecodeCache(uint16_t address, uint16_t length) {
+    for(uint16_t i = 0; i <= length; i++) {
+        decodedOp &entry = decodeCache[(address - 1 + i) & 0x0FFFu];
+        entry.handler = decodeHandler;
+        entry.op = OP_DECODE;
+    }
+}
+
+// Reset every cache entry, used when a ROM is loaded or memory is reinitialized
+void chip8::flushDecodeCache() {
+    if(!decodeCache)
+        return;
+    for(int i = 0; i < 4096; i++) {
+        decodeCache[i].handler = decodeHandler;
+        decodeCache[i].op = OP_DECODE;
+    }
+}
@@ -0,0 +1,107 @@
+#include "profiler.hpp"
+#include "disasm.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+using namespace std;
+
+// Sample every interval instructions, counted from the first instruction run
+profiler::profiler(long long interval) : interval(max(interval, 1LL)), nextSample(this->interval) {
+    fill(lastEntry, lastEntry + MEMORY_SIZE, ROOT);
+}
+
+// Record the current pc and the chain of subroutines that led to it
+// Addresses wrap at 4 KB like the classic pc does, XO-CHIP addresses all 64 KB
+void profiler::sample(const chip8 &emulator) {
+    const uint8_t *memory = emulator.getMemory();
+    unsigned mask = emulator.getMode() == Mode::XoChip ? 0xFFFFu : 0x0FFFu;
+    const uint16_t *stack = emulator.getStack();
+    int depth = min<int>(emulator.getSP(), 16);
+    chain.clear();
+    for(int i = 0; i < depth; i++) {
+        uint16_t call = (stack[i] - 2) & mask;
+        uint16_t opcode = (memory[call] << 8u) | memory[(call + 1) & mask];
+        chain.push_back((opcode & 0xF000u) == 0x2000u ? opcode & 0x0FFFu : UNKNOWN);
+    }
+    uint16_t pc = emulator.getPC() & mask;
+    addressSamples[pc]++;
+    lastEntry[pc] = chain.empty() ? ROOT : chain.back();
+    stacks[chain]++;
+    samples++;
+}
+
+// Execute count instructions, stopping at each sample point on the way
+void profiler::run(chip8 &emulator, long long count) {
+    uint64_t end = emulator.getCycles() + max(count, 0LL);
+    while(emulator.getCycles() < end) {
+        uint64_t chunkEnd = min(end, nextSample);
+        emulator.runCycles(chunkEnd - emulator.getCycles());
+        if(emulator.getCycles() == nextSample) {
+            sample(emulator);
+            nextSample += interval;
+        }
+    }
+}
+
+// Profiled equivalent of chip8::runFrame
+void profiler::runFrame(chip8 &emulator, int instructionsPerFrame) {
+    run(emulator, instructionsPerFrame);
+    emulator.decrementCounters();
+}
+
+// Number of samples taken so far
+uint64_t profiler::sampleCount() const {
+    return samples;
+}
+
+// Frame name of a subroutine entry address
+static string frameName(uint16_t entry) {
+    if(entry == profiler::ROOT) return "main";
+    if(entry == profiler::UNKNOWN) return "sub_unknown";
+    char name[16];
+    snprintf(name, sizeof(name), "sub_0x%03X", entry);
+    return name;
+}
+
+// Write the samples as folded stacks, the input format of flamegraph.pl
+bool profiler::writeFolded(const string &path) const {
+    FILE *out = fopen(path.c_str(), "w");
+    if(!out) {
+        cerr << "Could not open profile file " << path << endl;
+        return false;
+    }
+    for(const auto &stack : stacks) {
+        string line = frameName(ROOT);
+        for(uint16_t entry : stack.first)
+            line += ";" + frameName(entry);
+        fprintf(out, "%s %llu\n", line.c_str(), (unsigned long long)stack.second);
+    }
+    return fclose(out) == 0;
+}
+
+// Print the rows most sampled addresses, disassembled from the emulator's current memory in its mode
+void profiler::printHotSpots(const chip8 &emulator, size_t rows) const {
+    vector<uint16_t> addresses;
+    for(uint32_t address = 0; address < MEMORY_SIZE; address++) {
+        if(addressSamples[address])
+            addresses.push_back(address);
+    }
+    sort(addresses.begin(), addresses.end(), [this](uint16_t a, uint16_t b) {
+        return addressSamples[a] != addressSamples[b] ? addressSamples[a] > addressSamples[b] : a < b;
+    });
+    if(addresses.size() > rows)
+        addresses.resize(rows);
+
+    const uint8_t *memory = emulator.getMemory();
+    Mode mode = emulator.getMode();
+    unsigned mask = mode == Mode::XoChip ? 0xFFFFu : 0x0FFFu;
+    printf("%llu samples, one every %lld instructions\n", (unsigned long long)samples, interval);
+    printf("address  samples      %%  subroutine   instruction\n");
+    for(uint16_t address : addresses) {
+        uint16_t opcode = (memory[address] << 8u) | memory[(address + 1) & mask];
+        uint16_t next = (memory[(address + 2) & mask] << 8u) | memory[(address + 3) & mask];
+        printf("0x%-4X %9llu  %5.1f  %-11s  %04X  %s\n", address, (unsigned long long)addressSamples[address],
+               100.0 * addressSamples[address] / samples, frameName(lastEntry[address]).c_str(), opcode,
+               disassemble(opcode, mode, emulator.getQuirks(), next).c_str());
+    }
+}
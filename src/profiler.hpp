@@ -0,0 +1,45 @@
+#pragma once
+#include "CHIP8.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* ROM profiler
+ * Samples the emulated pc and call stack every interval instructions. It works on any
+ * engine, because run() splits execution at the sample points and reads only state that
+ * every engine keeps current.
+ *
+ * The stack holds return addresses. The subroutine each one belongs to is the target of the
+ * 2NNN just before it, so a sample reads as main;sub_0x2A0;sub_0x31C. The pc is attributed
+ * to the innermost subroutine.
+ *
+ * Output:
+ *  - folded stacks, one "frame;frame;frame count" line per distinct stack, for flamegraph.pl,
+ *    inferno or speedscope
+ *  - a hot-spot table of the most sampled addresses, with their subroutine and disassembly
+ */
+
+class profiler {
+    long long interval;
+    uint64_t nextSample;                    //Cycle count at which the next sample is taken
+    uint64_t samples{};
+    uint64_t addressSamples[MEMORY_SIZE]{}; //Classic programs only reach the first 4 KB
+    map<vector<uint16_t>, uint64_t> stacks; //Subroutine entry addresses, outermost first
+    vector<uint16_t> chain;                 //Scratch for sample
+    uint16_t lastEntry[MEMORY_SIZE];        //Innermost subroutine of the last sample at each address
+
+    void sample(const chip8 &emulator);
+
+public:
+    static constexpr uint16_t ROOT{0xFFFF};    //Stands for the code outside any subroutine
+    static constexpr uint16_t UNKNOWN{0xFFFE}; //Return address not preceded by a 2NNN
+
+    explicit profiler(long long interval);
+    void run(chip8 &emulator, long long count);
+    void runFrame(chip8 &emulator, int instructionsPerFrame);
+    uint64_t sampleCount() const;
+    bool writeFolded(const string &path) const;
+    void printHotSpots(const chip8 &emulator, size_t rows) const;
+};
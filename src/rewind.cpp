@@ -0,0 +1,193 @@
+#include "rewind.hpp"
+#include <cstring>
+using namespace std;
+
+// History of up to maxFrames frames in a ring of ringBytes bytes
+rewindBuffer::rewindBuffer(size_t maxFrames, size_t ringBytes)
+    : ring(max(ringBytes, sizeof(chip8State))), entries(max<size_t>(maxFrames, 2)),
+      delta(STATE_WORDS * sizeof(uint64_t) + (STATE_WORDS + 1) * 2 * sizeof(uint16_t)) {
+}
+
+// Entry index frames after the oldest one
+rewindBuffer::entry &rewindBuffer::at(size_t index) {
+    return entries[(head + index) % entries.size()];
+}
+
+// Sequence number of the oldest stored frame
+uint64_t rewindBuffer::oldestSequence() const {
+    return nextSequence - count;
+}
+
+// Drop the oldest frame, and the deltas that depended on it if it was a keyframe
+void rewindBuffer::dropOldest() {
+    do {
+        used -= at(0).length;
+        head = (head + 1) % entries.size();
+        count--;
+    } while(count > 0 && !at(0).keyframe);
+}
+
+// Find length contiguous ring bytes after the newest entry, dropping the oldest frames in the way
+bool rewindBuffer::reserve(size_t length, size_t &offset) {
+    if(length > ring.size())
+        return false;
+    if(writePos + length > ring.size()) {
+        //Entries past writePos are from the previous lap and older than everything at the start
+        while(count > 0 && at(0).offset >= writePos)
+            dropOldest();
+        writePos = 0;
+    }
+    while(count > 0 && at(0).offset < writePos + length && at(0).offset + at(0).length > writePos)
+        dropOldest();
+    offset = writePos;
+    writePos += length;
+    return true;
+}
+
+// XOR the first words words of state against base and run-length encode the zero words into delta,
+// returns the encoded size. The XOR pass is kept separate from the scan so the compiler can vectorize it
+size_t rewindBuffer::encodeDelta(const chip8State &state, const chip8State &base, size_t words) {
+    uint64_t diff[STATE_WORDS];
+    const uint8_t *a = reinterpret_cast<const uint8_t*>(&state);
+    const uint8_t *b = reinterpret_cast<const uint8_t*>(&base);
+    for(size_t i = 0; i < words; i++) {
+        uint64_t x, y;
+        memcpy(&x, a + i * 8, 8);
+        memcpy(&y, b + i * 8, 8);
+        diff[i] = x ^ y;
+    }
+
+    uint8_t *out = delta.data();
+    size_t i = 0;
+    while(i < words) {
+        size_t zeroStart = i;
+        while(i + 4 <= words && (diff[i] | diff[i + 1] | diff[i + 2] | diff[i + 3]) == 0)
+            i += 4;
+        while(i < words && diff[i] == 0)
+            i++;
+        uint16_t zeros = i - zeroStart;
+        size_t start = i;
+        while(i < words && diff[i] != 0)
+            i++;
+        uint16_t literals = i - start;
+        memcpy(out, &zeros, 2);
+        memcpy(out + 2, &literals, 2);
+        memcpy(out + 4, &diff[start], literals * 8);
+        out += 4 + literals * 8;
+    }
+    return out - delta.data();
+}
+
+// Apply an encoded delta of words words to state, which holds the keyframe it was made against
+void rewindBuffer::decodeDelta(const uint8_t *data, chip8State &state, size_t words) const {
+    uint8_t *bytes = reinterpret_cast<uint8_t*>(&state);
+    size_t i = 0;
+    while(i < words) {
+        uint16_t zeros, literals;
+        memcpy(&zeros, data, 2);
+        memcpy(&literals, data + 2, 2);
+        data += 4;
+        i += zeros;
+        for(uint16_t j = 0; j < literals; j++, i++, data += 8) {
+            uint64_t x, y;
+            memcpy(&x, bytes + i * 8, 8);
+            memcpy(&y, data, 8);
+            x ^= y;
+            memcpy(bytes + i * 8, &x, 8);
+        }
+    }
+}
+
+// Make key hold the keyframe with this sequence number, false if it was dropped
+bool rewindBuffer::loadKeyframe(uint64_t sequence) {
+    if(keySequence == sequence)
+        return true;
+    if(sequence < oldestSequence() || sequence >= nextSequence)
+        return false;
+    entry &e = at(sequence - oldestSequence());
+    memcpy(&key, &ring[e.offset], e.length);
+    keySequence = sequence;
+    return true;
+}
+
+// Append an entry whose data was reserved at offset
+void rewindBuffer::store(const uint8_t *data, size_t length, bool keyframe, uint64_t keyframeSequence) {
+    size_t offset;
+    if(!reserve(length, offset))
+        return;
+    memcpy(&ring[offset], data, length);
+    at(count) = {offset, uint32_t(length), keyframe, keyframeSequence};
+    count++;
+    used += length;
+    nextSequence++;
+}
+
+// Record the state at the end of a frame
+// A frame whose snapshot size differs from its keyframe's, after a mode change, starts a new keyframe
+void rewindBuffer::capture(const chip8 &emulator) {
+    emulator.saveState(current);
+    if(count == entries.size())
+        dropOldest();
+
+    if(count > 0) {
+        uint64_t keyframe = at(count - 1).keySequence;
+        if(nextSequence - keyframe < KEYFRAME_INTERVAL && loadKeyframe(keyframe) && key.size == current.size) {
+            size_t length = encodeDelta(current, key, current.size / sizeof(uint64_t));
+            size_t offset;
+            if(length < current.size && reserve(length, offset)) {
+                //Making room can drop the keyframe itself, the frame is then stored whole
+                if(keyframe >= oldestSequence()) {
+                    memcpy(&ring[offset], delta.data(), length);
+                    at(count) = {offset, uint32_t(length), false, keyframe};
+                    count++;
+                    used += length;
+                    nextSequence++;
+                    return;
+                }
+                writePos = offset;
+            }
+        }
+    }
+    memcpy(&key, &current, current.size);
+    keySequence = nextSequence;
+    store(reinterpret_cast<const uint8_t*>(&current), current.size, true, nextSequence);
+}
+
+// Forget the newest frame and restore the one before it, false when there is nothing left to rewind to
+bool rewindBuffer::stepBack(chip8 &emulator) {
+    if(count < 2)
+        return false;
+    entry last = at(count - 1);
+    writePos = last.offset;
+    used -= last.length;
+    count--;
+    nextSequence--;
+    if(last.keyframe && keySequence == nextSequence)
+        keySequence = ~0ull;
+
+    entry &e = at(count - 1);
+    if(e.keyframe) {
+        memcpy(&current, &ring[e.offset], e.length);
+    } else {
+        loadKeyframe(e.keySequence);
+        memcpy(&current, &key, key.size);
+        decodeDelta(&ring[e.offset], current, key.size / sizeof(uint64_t));
+    }
+    return emulator.loadState(current);
+}
+
+// Drop the whole history, used after loading a ROM or a save-state
+void rewindBuffer::clear() {
+    head = count = used = writePos = 0;
+    keySequence = ~0ull;
+}
+
+// Number of frames that can be rewound through
+size_t rewindBuffer::frames() const {
+    return count;
+}
+
+// Ring bytes held by stored frames
+size_t rewindBuffer::bytesUsed() const {
+    return used;
+}
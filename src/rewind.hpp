@@ -0,0 +1,65 @@
+#pragma once
+#include "CHIP8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+/* Rewind history
+ * Keeps the most recent frames of machine state in a fixed-size byte ring so rewinding can
+ * be always on. Every KEYFRAME_INTERVAL frames a full snapshot is stored, the frames in
+ * between are stored as the XOR of their state against that keyframe, run-length encoded
+ * over 64-bit words: most frames only touch a few registers, timers and display rows, so
+ * a delta is usually tens of bytes.
+ *
+ * Only the part of chip8State the mode uses is stored (chip8State::size bytes, 4.5 KB for
+ * classic CHIP-8), and deltas cover just those words.
+ *
+ * Delta format: repeated (uint16 zero words, uint16 literal words, literal words...) tokens
+ * until all size / 8 words of the keyframe are covered.
+ *
+ * When the ring is full the oldest frames are dropped, together with any deltas whose keyframe
+ * went with them.
+ */
+
+class rewindBuffer {
+    static const int KEYFRAME_INTERVAL{60};
+    static const size_t STATE_WORDS{sizeof(chip8State) / sizeof(uint64_t)};
+    static_assert(sizeof(chip8State) / sizeof(uint64_t) < 0xFFFF, "run lengths are 16 bit");
+
+    struct entry {
+        size_t offset;                      //Position in the byte ring
+        uint32_t length;
+        bool keyframe;
+        uint64_t keySequence;               //Sequence number of the keyframe this entry is relative to
+    };
+
+    vector<uint8_t> ring;
+    size_t writePos{};
+    vector<entry> entries;                  //Circular, oldest at head
+    size_t head{};
+    size_t count{};
+    size_t used{};                          //Bytes held by live entries
+    uint64_t nextSequence{};                //Sequence number of the next captured frame
+    chip8State current;                     //Scratch state for capture and restore
+    chip8State key;                         //Decoded keyframe of the newest entry
+    uint64_t keySequence{~0ull};            //Which keyframe key holds
+    vector<uint8_t> delta;                  //Scratch encoding, sized for the worst case
+
+    entry &at(size_t index);
+    uint64_t oldestSequence() const;
+    void dropOldest();
+    bool reserve(size_t length, size_t &offset);
+    size_t encodeDelta(const chip8State &state, const chip8State &base, size_t words);
+    void decodeDelta(const uint8_t *data, chip8State &state, size_t words) const;
+    bool loadKeyframe(uint64_t sequence);
+    void store(const uint8_t *data, size_t length, bool keyframe, uint64_t keyframeSequence);
+
+public:
+    rewindBuffer(size_t maxFrames, size_t ringBytes);
+    void capture(const chip8 &emulator);
+    bool stepBack(chip8 &emulator);
+    void clear();
+    size_t frames() const;
+    size_t bytesUsed() const;
+};
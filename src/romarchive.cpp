@@ -0,0 +1,226 @@
+#include "romarchive.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const size_t ROM_ALIGNMENT{16};
+
+// Unmap the archive on destruction
+romArchive::~romArchive() {
+    close();
+}
+
+// Drop the current mapping, if any
+void romArchive::close() {
+#if defined(_WIN32)
+    if(base)
+        UnmapViewOfFile(base);
+    if(mapping)
+        CloseHandle(mapping);
+    mapping = NULL;
+#else
+    if(base)
+        munmap(const_cast<uint8_t*>(base), length);
+#endif
+    base = NULL;
+    length = 0;
+    entries = NULL;
+    count = 0;
+}
+
+// Map an archive written by write, false (and nothing mapped) if it is missing, truncated or of another version
+// Every entry is bounds-checked here so lookups and data() never need to
+bool romArchive::open(const char *filename) {
+    close();
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        cerr << "Could not open ROM archive!" << endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < LONGLONG(sizeof(romArchiveHeader))) {
+        CloseHandle(file);
+        cerr << "ROM archive is truncated!" << endl;
+        return false;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping)
+        base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!base) {
+        close();
+        cerr << "Could not map ROM archive!" << endl;
+        return false;
+    }
+    length = size_t(fileSize.QuadPart);
+#else
+    int file = ::open(filename, O_RDONLY);
+    if(file < 0) {
+        cerr << "Could not open ROM archive!" << endl;
+        return false;
+    }
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size < off_t(sizeof(romArchiveHeader))) {
+        ::close(file);
+        cerr << "ROM archive is truncated!" << endl;
+        return false;
+    }
+    void *view = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+    if(view == MAP_FAILED) {
+        cerr << "Could not map ROM archive!" << endl;
+        return false;
+    }
+    base = static_cast<const uint8_t*>(view);
+    length = size_t(info.st_size);
+#endif
+
+    romArchiveHeader header;
+    memcpy(&header, base, sizeof(header));
+    bool valid = header.magic == ROM_ARCHIVE_MAGIC && header.version == ROM_ARCHIVE_VERSION;
+    if(valid && (header.fileSize != length || sizeof(header) + uint64_t(header.entryCount) * sizeof(romEntry) > header.namesOffset
+                 || header.namesOffset > length)) {
+        close();
+        cerr << "ROM archive is truncated!" << endl;
+        return false;
+    }
+    const romEntry *table = reinterpret_cast<const romEntry*>(base + sizeof(header));
+    for(uint32_t i = 0; valid && i < header.entryCount; i++) {
+        valid = uint64_t(table[i].offset) + table[i].size <= length
+                && table[i].nameOffset >= header.namesOffset && uint64_t(table[i].nameOffset) + table[i].nameLength <= length
+                && table[i].mode <= uint8_t(Mode::XoChip) && table[i].quirks <= uint8_t(Quirks::XoChip)
+                && (i == 0 || table[i - 1].hash < table[i].hash);
+    }
+    if(!valid) {
+        close();
+        cerr << "ROM archive has an unsupported format!" << endl;
+        return false;
+    }
+    entries = table;
+    count = header.entryCount;
+    return true;
+}
+
+// Number of ROMs in the archive
+size_t romArchive::size() const {
+    return count;
+}
+
+// Index entry of ROM index, entries are in hash order
+const romEntry &romArchive::entry(size_t index) const {
+    return entries[index];
+}
+
+// Entry of the ROM whose image hashes to hash, null if there is none (binary search of the index)
+const romEntry *romArchive::findHash(uint64_t hash) const {
+    const romEntry *found = lower_bound(entries, entries + count, hash,
+                                        [](const romEntry &entry, uint64_t value) { return entry.hash < value; });
+    return (found != entries + count && found->hash == hash) ? found : NULL;
+}
+
+// Entry of the ROM stored under name, null if there is none
+// Names are not indexed: look a ROM up by hash when it is done per job
+const romEntry *romArchive::findName(const string &name) const {
+    for(uint32_t i = 0; i < count; i++) {
+        if(entries[i].nameLength == name.size() && !memcmp(base + entries[i].nameOffset, name.data(), name.size()))
+            return &entries[i];
+    }
+    return NULL;
+}
+
+// Name the ROM was packed under, relative to the packed directory
+string romArchive::name(const romEntry &entry) const {
+    return string(reinterpret_cast<const char*>(base + entry.nameOffset), entry.nameLength);
+}
+
+// ROM image inside the mapping, valid until the archive is closed
+const uint8_t *romArchive::data(const romEntry &entry) const {
+    return base + entry.offset;
+}
+
+// FNV-1a of a ROM image, the key of the archive index
+uint64_t romArchive::hashData(const uint8_t *data, size_t length) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Write roms as an archive, false on I/O errors
+// ROMs are indexed by content, a ROM whose image is already in the archive under another name is left out
+bool romArchive::write(const char *filename, vector<romRecord> roms) {
+    vector<pair<uint64_t, size_t>> order;
+    for(size_t i = 0; i < roms.size(); i++)
+        order.push_back({hashData(roms[i].data.data(), roms[i].data.size()), i});
+    stable_sort(order.begin(), order.end(),
+                [](const pair<uint64_t, size_t> &a, const pair<uint64_t, size_t> &b) { return a.first < b.first; });
+    vector<pair<uint64_t, size_t>> kept;
+    for(const auto &rom : order) {
+        if(!kept.empty() && kept.back().first == rom.first) {
+            cerr << "Skipping " << roms[rom.second].name << ", same image as " << roms[kept.back().second].name << endl;
+            continue;
+        }
+        kept.push_back(rom);
+    }
+
+    romArchiveHeader header{ROM_ARCHIVE_MAGIC, ROM_ARCHIVE_VERSION, 0, uint32_t(kept.size()), 0, 0};
+    vector<romEntry> table(kept.size());
+    size_t position = sizeof(header) + table.size() * sizeof(romEntry);
+    header.namesOffset = uint32_t(position);
+    for(size_t i = 0; i < kept.size(); i++) {
+        const romRecord &rom = roms[kept[i].second];
+        table[i].hash = kept[i].first;
+        table[i].nameOffset = uint32_t(position);
+        table[i].nameLength = uint16_t(min<size_t>(rom.name.size(), 0xFFFF));
+        table[i].instructionsPerFrame = uint16_t(rom.instructionsPerFrame);
+        table[i].mode = uint8_t(rom.mode);
+        table[i].quirks = uint8_t(rom.quirks);
+        position += table[i].nameLength;
+    }
+    for(size_t i = 0; i < kept.size(); i++) {
+        position = (position + ROM_ALIGNMENT - 1) & ~(ROM_ALIGNMENT - 1);
+        table[i].offset = uint32_t(position);
+        table[i].size = uint32_t(roms[kept[i].second].data.size());
+        position += table[i].size;
+    }
+    header.fileSize = position;
+    if(position > 0xFFFFFFFFu) {
+        cerr << "ROM archive would be larger than 4 GB!" << endl;
+        return false;
+    }
+
+    vector<uint8_t> image(position, 0);
+    memcpy(image.data(), &header, sizeof(header));
+    if(!table.empty())
+        memcpy(image.data() + sizeof(header), table.data(), table.size() * sizeof(romEntry));
+    for(size_t i = 0; i < kept.size(); i++) {
+        const romRecord &rom = roms[kept[i].second];
+        memcpy(image.data() + table[i].nameOffset, rom.name.data(), table[i].nameLength);
+        if(!rom.data.empty())
+            memcpy(image.data() + table[i].offset, rom.data.data(), rom.data.size());
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if(!file) {
+        cerr << "Could not open ROM archive file!" << endl;
+        return false;
+    }
+    bool written = fwrite(image.data(), image.size(), 1, file) == 1;
+    written = (fclose(file) == 0) && written;
+    if(!written)
+        cerr << "Could not write ROM archive file!" << endl;
+    return written;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "CHIP8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* ROM archives
+ * A ROM library packed into one file by chip8-pack, with a header index of every ROM: name,
+ * FNV-1a content hash, size, offset and the recommended mode, quirks profile and instructions
+ * per frame. romArchive memory-maps the file read-only, so a corpus of any size costs one open
+ * and one mapping, and emulator instances load their ROM straight from the mapped pages.
+ *
+ * File layout (host byte order, like save-states): romArchiveHeader, entryCount romEntry records
+ * sorted by hash, the name table, then the ROM images, each starting on a 16-byte boundary.
+ * All offsets are from the start of the file.
+ */
+
+static const uint32_t ROM_ARCHIVE_MAGIC{0x41523843u};   //"C8RA" when stored little-endian
+static const uint16_t ROM_ARCHIVE_VERSION{1};
+
+struct romArchiveHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t entryCount;
+    uint32_t namesOffset;                   //Start of the name table
+    uint64_t fileSize;                      //Catches truncated copies
+};
+static_assert(sizeof(romArchiveHeader) == 24, "romArchiveHeader layout must not contain padding");
+
+struct romEntry {
+    uint64_t hash;                          //FNV-1a of the ROM image
+    uint32_t offset;                        //ROM image
+    uint32_t size;
+    uint32_t nameOffset;                    //Name, not terminated
+    uint16_t nameLength;
+    uint16_t instructionsPerFrame;          //Recommended, 0 when unknown
+    uint8_t mode;                           //Mode
+    uint8_t quirks;                         //Quirks
+    uint8_t reserved[6];
+};
+static_assert(sizeof(romEntry) == 32, "romEntry layout must not contain padding");
+
+//One ROM handed to romArchive::write
+struct romRecord {
+    string name;
+    vector<uint8_t> data;
+    Mode mode{Mode::Chip8};
+    Quirks quirks{Quirks::Default};
+    int instructionsPerFrame{};
+};
+
+class romArchive {
+    const uint8_t *base{};
+    size_t length{};
+    const romEntry *entries{};
+    uint32_t count{};
+#if defined(_WIN32)
+    void *mapping{};
+#endif
+
+    void close();
+
+public:
+    romArchive() = default;
+    ~romArchive();
+    romArchive(const romArchive &) = delete;
+    romArchive &operator=(const romArchive &) = delete;
+
+    bool open(const char *filename);
+    size_t size() const;
+    const romEntry &entry(size_t index) const;
+    const romEntry *findHash(uint64_t hash) const;
+    const romEntry *findName(const string &name) const;
+    string name(const romEntry &entry) const;
+    const uint8_t *data(const romEntry &entry) const;
+
+    static uint64_t hashData(const uint8_t *data, size_t length);
+    static bool write(const char *filename, vector<romRecord> roms);
+};
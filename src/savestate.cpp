@@ -0,0 +1,143 @@
+#include "CHIP8.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+/* Save-states
+ * Snapshots copy each machine field into chip8State with memcpy, there is no per-field
+ * encoding. Restoring only drops pre-decoded and recompiled code when memory actually
+ * differs, so search and fuzzing loops that rewind to a checkpoint of the same program
+ * keep their translations.
+ */
+
+// Bytes of chip8State a snapshot of mode fills, a multiple of 8 so rewind can XOR it in words
+size_t chip8::stateSize(Mode mode) {
+    switch(mode) {
+    case Mode::Chip8:
+        return offsetof(chip8State, planes);
+    case Mode::SuperChip:
+        return offsetof(chip8State, highMemory);
+    default:
+        return sizeof(chip8State);
+    }
+}
+static_assert(offsetof(chip8State, planes) % 8 == 0 && offsetof(chip8State, highMemory) % 8 == 0,
+              "snapshot sizes must be whole words");
+
+// Copy the machine state into state, only the first stateSize(mode) bytes are written
+void chip8::saveState(chip8State &state) const {
+    state.magic = STATE_MAGIC;
+    state.version = STATE_VERSION;
+    state.mode = uint8_t(mode);
+    state.hires = hires;
+    state.size = uint32_t(stateSize(mode));
+    state.planeMask = planeMask;
+    state.pitch = pitch;
+    state.patternLoaded = patternLoaded;
+    state.reserved0 = 0;
+    memcpy(state.screen, chip8Screen, sizeof(chip8Screen));
+    state.rng = rng;
+    state.cycles = cycles;
+    memcpy(state.stack, stack, sizeof(stack));
+    memcpy(state.registers, registers, sizeof(registers));
+    memcpy(state.keypad, keypad, sizeof(keypad));
+    memcpy(state.flags, flags, sizeof(flags));
+    memcpy(state.audioPattern, audioPattern, sizeof(audioPattern));
+    state.indreg = indreg;
+    state.pc = pc;
+    state.opcode = opcode;
+    state.sp = sp;
+    state.delay = delay;
+    state.soundTimer = soundTimer;
+    memset(state.reserved, 0, sizeof(state.reserved));
+    memcpy(state.memory, memory, sizeof(state.memory));
+    if(mode != Mode::Chip8)
+        memcpy(state.planes, planes, sizeof(planes));
+    if(mode == Mode::XoChip)
+        memcpy(state.highMemory, memory + 4096, sizeof(state.highMemory));
+}
+
+// Restore the machine state from state, false (and nothing changed) if it is not a snapshot of this version
+// Memory above 4 KB is only part of XO-CHIP snapshots and is left alone otherwise
+bool chip8::loadState(const chip8State &state) {
+    if(state.magic != STATE_MAGIC || state.version != STATE_VERSION || state.mode > uint8_t(Mode::XoChip)
+       || state.size != stateSize(Mode(state.mode))) {
+        cerr << "Save-state has an unsupported format!" << endl;
+        return false;
+    }
+    Mode saved = Mode(state.mode);
+    bool memoryChanged = memcmp(memory, state.memory, sizeof(state.memory)) != 0
+                         || (saved == Mode::XoChip && memcmp(memory + 4096, state.highMemory, sizeof(state.highMemory)) != 0);
+    if(memoryChanged) {
+        memcpy(memory, state.memory, sizeof(state.memory));
+        if(saved == Mode::XoChip)
+            memcpy(memory + 4096, state.highMemory, sizeof(state.highMemory));
+        flushCode();
+    }
+    for(int i = 0; i < 32; i++) {
+        if(chip8Screen[i] != state.screen[i]) 
+            dirtyRows |= 1u << i;
+    }
+    memcpy(chip8Screen, state.screen, sizeof(chip8Screen));
+    if(saved != Mode::Chip8) {
+        if(memcmp(planes, state.planes, sizeof(planes)) != 0) 
+            dirtyRows = 0xFFFFFFFFu;
+        memcpy(planes, state.planes, sizeof(planes));
+    } else {
+        memset(planes, 0, sizeof(planes));
+    }
+    mode = saved;
+    hires = state.hires != 0;
+    planeMask = state.planeMask & 3u;
+    pitch = state.pitch;
+    patternLoaded = state.patternLoaded != 0;
+    memcpy(flags, state.flags, sizeof(flags));
+    memcpy(audioPattern, state.audioPattern, sizeof(audioPattern));
+    rng = state.rng ? state.rng : 1u;
+    cycles = state.cycles;
+    memcpy(stack, state.stack, sizeof(stack));
+    memcpy(registers, state.registers, sizeof(registers));
+    memcpy(keypad, state.keypad, sizeof(keypad));
+    indreg = state.indreg;
+    pc = state.pc;
+    opcode = state.opcode;
+    sp = state.sp;
+    delay = state.delay;
+    soundTimer = state.soundTimer;
+    return true;
+}
+
+// Write a snapshot to a file, the file is the used part of the chip8State struct as-is
+bool chip8::saveState(const char *filename) const {
+    chip8State state;
+    saveState(state);
+    FILE *file = fopen(filename, "wb");
+    if(!file) {
+        cerr << "Could not open save-state file!" << endl;
+        return false;
+    }
+    bool written = fwrite(&state, state.size, 1, file) == 1;
+    written = (fclose(file) == 0) && written;
+    if(!written)
+        cerr << "Could not write save-state file!" << endl;
+    return written;
+}
+
+// Read a snapshot written by saveState(filename)
+bool chip8::loadState(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if(!file) {
+        cerr << "Could not open save-state file!" << endl;
+        return false;
+    }
+    chip8State state;
+    size_t length = fread(&state, 1, sizeof(state), file);
+    fclose(file);
+    if(length < offsetof(chip8State, planeMask) || length != state.size) {
+        cerr << "Save-state file is truncated!" << endl;
+        return false;
+    }
+    return loadState(state);
+}
@@ -0,0 +1,54 @@
+#include "scheduler.hpp"
+#include <algorithm>
+using namespace std;
+
+// Start the clock now
+frameScheduler::frameScheduler() {
+    reset();
+}
+
+// Restart the clock, the first frame is due immediately
+void frameScheduler::reset() {
+    start = chrono::steady_clock::now();
+    frame = 0;
+}
+
+// Run at multiple times 60 Hz from now on, 0 runs uncapped
+// The clock restarts so frames already run are not made up at the new rate
+void frameScheduler::setSpeed(int multiple) {
+    speed = max(0, multiple);
+    reset();
+}
+
+// Time at which frame index is due, exact in nanoseconds
+chrono::steady_clock::time_point frameScheduler::frameTime(int64_t index) const {
+    return start + chrono::nanoseconds(index * 1000000000 / (FRAME_RATE * speed));
+}
+
+// Number of frames to run now, and marks them as run
+// After a stall longer than MAX_CATCH_UP frames the clock is moved forward instead of fast-forwarding the game
+int frameScheduler::framesDue() {
+    if(speed == 0)
+        return UNCAPPED_BATCH;
+    auto now = chrono::steady_clock::now();
+    int catchUp = MAX_CATCH_UP * speed;
+    int due = 0;
+    while(frameTime(frame + due) <= now && due < catchUp) 
+        due++;
+    frame += due;
+    if(due == catchUp && frameTime(frame) <= now) {
+        start = now;
+        frame = 1;
+    }
+    return due;
+}
+
+// Time left until the next frame is due, zero if it is already due
+chrono::nanoseconds frameScheduler::timeUntilNextFrame() const {
+    if(speed == 0)
+        return chrono::nanoseconds(0);
+    auto remaining = frameTime(frame) - chrono::steady_clock::now();
+    if(remaining < chrono::nanoseconds(0)) 
+        return chrono::nanoseconds(0);
+    return chrono::duration_cast<chrono::nanoseconds>(remaining);
+}
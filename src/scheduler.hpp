@@ -0,0 +1,33 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+using namespace std;
+
+/* Fixed-step 60 Hz frame clock
+ * Frame k is due at start + k/60 s, computed from the frame count so the clock never drifts.
+ * The emulator runs each due frame as one batch of instructions followed by a timer tick,
+ * the host sleeps (or waits for events) until the next frame is due.
+ *
+ * setSpeed(N) runs the clock at N times 60 Hz for turbo mode, speed 0 removes the cap and
+ * hands out UNCAPPED_BATCH frames on every call. Emulated time still advances one timer
+ * tick per frame, only the wall clock pacing changes.
+ */
+
+class frameScheduler {
+    static const int64_t FRAME_RATE{60};
+    static const int MAX_CATCH_UP{4};                   //Frames run back to back before resyncing, per 1x of speed
+    static const int UNCAPPED_BATCH{8};                 //Frames per call when running uncapped
+
+    chrono::steady_clock::time_point start;
+    int64_t frame{};                                    //Next frame to run
+    int speed{1};                                       //Multiple of 60 Hz, 0 when uncapped
+
+    chrono::steady_clock::time_point frameTime(int64_t index) const;
+
+public:
+    frameScheduler();
+    void reset();
+    void setSpeed(int multiple);
+    int framesDue();
+    chrono::nanoseconds timeUntilNextFrame() const;
+};
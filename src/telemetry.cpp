@@ -0,0 +1,157 @@
+#include "telemetry.hpp"
+#include "disasm.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+using namespace std;
+
+// Count one sample of ns nanoseconds
+void telemetry::timeStats::add(uint64_t ns) {
+    count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    totalNs.store(totalNs.load(memory_order_relaxed) + ns, memory_order_relaxed);
+    uint64_t bucket = min<uint64_t>(ns / 1000000, HISTOGRAM_BUCKETS - 1);
+    histogram[bucket].store(histogram[bucket].load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Telemetry written to path at exit, and every exportSeconds seconds if that is positive
+telemetry::telemetry(const string &path, double exportSeconds)
+    : path(path), exportInterval(chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(exportSeconds))),
+      lastExport(chrono::steady_clock::now()) {
+    if(countsOpcodes()) {
+        opcodeCounts.reset(new uint64_t[OPCODE_COUNT]);
+        fill(opcodeCounts.get(), opcodeCounts.get() + OPCODE_COUNT, 0);
+    }
+}
+
+// Counter array for chip8::setOpcodeCounters, null when opcode counting is compiled out
+uint64_t *telemetry::opcodeCounters() {
+    return opcodeCounts.get();
+}
+
+// Name the opcode families of the export in the instruction set of mode, the counted emulator's
+void telemetry::setMode(Mode mode) {
+    this->mode = mode;
+}
+
+// One emulated frame of frameInstructions instructions took elapsed
+void telemetry::recordFrame(uint64_t frameInstructions, chrono::steady_clock::duration elapsed) {
+    frames.store(frames.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    instructions.store(instructions.load(memory_order_relaxed) + frameInstructions, memory_order_relaxed);
+    if(frameInstructions < minFrameInstructions.load(memory_order_relaxed))
+        minFrameInstructions.store(frameInstructions, memory_order_relaxed);
+    if(frameInstructions > maxFrameInstructions.load(memory_order_relaxed))
+        maxFrameInstructions.store(frameInstructions, memory_order_relaxed);
+    emulate.add(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+}
+
+// One frame was drawn and presented in elapsed
+void telemetry::recordRender(chrono::steady_clock::duration elapsed) {
+    auto now = chrono::steady_clock::now();
+    if(lastPresent != chrono::steady_clock::time_point{})
+        presentInterval.add(chrono::duration_cast<chrono::nanoseconds>(now - lastPresent).count());
+    lastPresent = now;
+    render.add(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+}
+
+// One audio callback took elapsed
+void telemetry::recordAudio(chrono::steady_clock::duration elapsed) {
+    audio.add(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+}
+
+// latency of audio was queued between the emulator and the speaker, called from the render thread
+void telemetry::recordAudioLatency(chrono::nanoseconds latency) {
+    audioLatency.add(latency.count() > 0 ? latency.count() : 0);
+}
+
+// A key press first reached the screen latency after the key went down, called from the render thread
+void telemetry::recordInputLatency(chrono::nanoseconds latency) {
+    uint64_t ns = latency.count() > 0 ? latency.count() : 0;
+    inputLatency.add(ns);
+    if(ns > maxInputLatencyNs.load(memory_order_relaxed))
+        maxInputLatencyNs.store(ns, memory_order_relaxed);
+}
+
+// Write the JSON file if the export interval has passed, called from the emulation thread
+void telemetry::exportIfDue() {
+    if(exportInterval <= chrono::steady_clock::duration::zero())
+        return;
+    auto now = chrono::steady_clock::now();
+    if(now - lastExport < exportInterval)
+        return;
+    lastExport = now;
+    writeJson();
+}
+
+// Print one timeStats as a JSON object
+static void writeTimes(FILE *out, const char *name, const atomic<uint64_t> &count, const atomic<uint64_t> &totalNs,
+                       const atomic<uint64_t> *histogram, bool last) {
+    uint64_t n = count.load(memory_order_relaxed);
+    double totalMs = totalNs.load(memory_order_relaxed) / 1e6;
+    fprintf(out, "    \"%s\": {\"count\": %llu, \"total_ms\": %.3f, \"mean_ms\": %.4f, \"histogram_1ms\": [", name,
+            (unsigned long long)n, totalMs, n ? totalMs / n : 0.0);
+    for(int i = 0; i < telemetry::HISTOGRAM_BUCKETS; i++)
+        fprintf(out, "%s%llu", i ? ", " : "", (unsigned long long)histogram[i].load(memory_order_relaxed));
+    fprintf(out, "]}%s\n", last ? "" : ",");
+}
+
+// Upper edge in ms of the histogram bucket holding the given fraction of count samples
+static int percentileMs(const atomic<uint64_t> *histogram, uint64_t count, double fraction) {
+    if(count == 0)
+        return 0;
+    uint64_t target = uint64_t(count * fraction + 0.999999);
+    uint64_t seen = 0;
+    for(int i = 0; i < telemetry::HISTOGRAM_BUCKETS; i++) {
+        seen += histogram[i].load(memory_order_relaxed);
+        if(seen >= target && seen > 0)
+            return i + 1;
+    }
+    return telemetry::HISTOGRAM_BUCKETS;
+}
+
+// Write everything collected so far to the telemetry file
+bool telemetry::writeJson() const {
+    FILE *out = fopen(path.c_str(), "w");
+    if(!out) {
+        cerr << "Could not open telemetry file " << path << endl;
+        return false;
+    }
+    uint64_t frameCount = frames.load(memory_order_relaxed);
+    uint64_t instructionCount = instructions.load(memory_order_relaxed);
+    fprintf(out, "{\n  \"frames\": %llu,\n  \"instructions\": %llu,\n", (unsigned long long)frameCount,
+            (unsigned long long)instructionCount);
+    fprintf(out, "  \"instructions_per_frame\": {\"min\": %llu, \"max\": %llu, \"mean\": %.2f},\n",
+            (unsigned long long)(frameCount ? minFrameInstructions.load(memory_order_relaxed) : 0),
+            (unsigned long long)maxFrameInstructions.load(memory_order_relaxed),
+            frameCount ? double(instructionCount) / frameCount : 0.0);
+    fprintf(out, "  \"time\": {\n");
+    writeTimes(out, "emulate", emulate.count, emulate.totalNs, emulate.histogram, false);
+    writeTimes(out, "render", render.count, render.totalNs, render.histogram, false);
+    writeTimes(out, "present_interval", presentInterval.count, presentInterval.totalNs, presentInterval.histogram, false);
+    writeTimes(out, "audio", audio.count, audio.totalNs, audio.histogram, false);
+    writeTimes(out, "audio_latency", audioLatency.count, audioLatency.totalNs, audioLatency.histogram, false);
+    writeTimes(out, "input_latency", inputLatency.count, inputLatency.totalNs, inputLatency.histogram, true);
+    fprintf(out, "  },\n");
+    uint64_t presses = inputLatency.count.load(memory_order_relaxed);
+    fprintf(out, "  \"input_latency_ms\": {\"p50\": %d, \"p90\": %d, \"p99\": %d, \"max\": %.3f},\n",
+            percentileMs(inputLatency.histogram, presses, 0.50), percentileMs(inputLatency.histogram, presses, 0.90),
+            percentileMs(inputLatency.histogram, presses, 0.99), maxInputLatencyNs.load(memory_order_relaxed) / 1e6);
+
+    if(opcodeCounts) {
+        map<string, uint64_t> families;
+        for(size_t op = 0; op < OPCODE_COUNT; op++) {
+            if(opcodeCounts[op])
+                families[opcodeFamily(op, mode)] += opcodeCounts[op];
+        }
+        fprintf(out, "  \"opcodes\": {");
+        bool first = true;
+        for(const auto &family : families) {
+            fprintf(out, "%s\n    \"%s\": %llu", first ? "" : ",", family.first.c_str(), (unsigned long long)family.second);
+            first = false;
+        }
+        fprintf(out, "\n  }\n}\n");
+    } else {
+        fprintf(out, "  \"opcodes\": null\n}\n");
+    }
+    return fclose(out) == 0;
+}
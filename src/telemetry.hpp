@@ -0,0 +1,76 @@
+#pragma once
+#include "CHIP8.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+using namespace std;
+
+/* Runtime telemetry
+ * Collects instruction counts per opcode, instructions per frame, time spent emulating,
+ * rendering and generating audio, frame time histograms, queued audio latency and
+ * input-to-photon latency.
+ * It is written as JSON on exit and, optionally, every few seconds.
+ *
+ * Opcode counting hooks chip8::decodeExe and only exists in builds with CHIP8_TELEMETRY
+ * defined. Without it the core is unchanged, and a frontend that is not asked for
+ * telemetry does one null check per frame. While counting, runCycles uses the reference
+ * interpreter, the only engine that decodes every instruction through decodeExe.
+ *
+ * Each recorder is called from one thread (emulation, render or audio). The counters
+ * are relaxed atomics, so an export from the emulation thread sees consistent values.
+ */
+
+class telemetry {
+public:
+    static const int HISTOGRAM_BUCKETS{65};         //1 ms buckets, the last one holds everything longer
+    static const size_t OPCODE_COUNT{65536};
+
+private:
+    struct timeStats {
+        atomic<uint64_t> count{};
+        atomic<uint64_t> totalNs{};
+        atomic<uint64_t> histogram[HISTOGRAM_BUCKETS]{};
+        void add(uint64_t ns);
+    };
+
+    string path;
+    chrono::steady_clock::duration exportInterval;
+    chrono::steady_clock::time_point lastExport;
+    unique_ptr<uint64_t[]> opcodeCounts;            //Indexed by the whole opcode, grouped by family on export
+    Mode mode{Mode::Chip8};                         //Instruction set the families are named in
+
+    atomic<uint64_t> frames{};
+    atomic<uint64_t> instructions{};
+    atomic<uint64_t> minFrameInstructions{~0ull};
+    atomic<uint64_t> maxFrameInstructions{};
+    timeStats emulate;                              //Per emulated frame
+    timeStats render;                               //Per presented frame
+    timeStats presentInterval;                      //Between presented frames
+    timeStats audio;                                //Per audio callback
+    timeStats audioLatency;                         //Audio queued ahead of the speaker, sampled per rendered frame
+    timeStats inputLatency;                         //Key press to the first presented frame that was emulated with it
+    atomic<uint64_t> maxInputLatencyNs{};
+    chrono::steady_clock::time_point lastPresent{};
+
+public:
+    static constexpr bool countsOpcodes() {
+#if defined(CHIP8_TELEMETRY)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    explicit telemetry(const string &path, double exportSeconds = 0);
+    uint64_t *opcodeCounters();
+    void setMode(Mode mode);
+    void recordFrame(uint64_t frameInstructions, chrono::steady_clock::duration elapsed);
+    void recordRender(chrono::steady_clock::duration elapsed);
+    void recordAudio(chrono::steady_clock::duration elapsed);
+    void recordAudioLatency(chrono::nanoseconds latency);
+    void recordInputLatency(chrono::nanoseconds latency);
+    void exportIfDue();
+    bool writeJson() const;
+};
@@ -0,0 +1,461 @@
+#include "../src/CHIP8.hpp"
+#include "../src/lanes.hpp"
+#include "../src/romarchive.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/* chip8-batch
+ * Runs many independent emulator instances in parallel, one job per (ROM, seed, input script)
+ * Jobs are spread over a work-stealing thread pool sized to the host cores
+ * Each job prints one CSV record: cycles executed, FNV-1a hash of the final display, exit reason
+ * With --engine lanes, jobs of the same ROM are bundled and each bundle runs on the lockstep lane engine
+ * With --archive, every ROM of a packed archive is run straight from the mapped file, with the mode,
+ * quirks profile and instructions per frame recorded for it unless given on the command line
+ *
+ * Usage: chip8-batch [options] [--archive FILE] <rom>...
+ *
+ * Input scripts are text files with one "<frame> <keys>" pair per line, keys being a hex mask
+ * of the pressed keys (bit K = key K), applied before that frame runs. '#' starts a comment.
+ */
+
+static const int DEFAULT_IPF{11};
+static const long long DEFAULT_FRAMES{600};
+
+// Print usage to stderr
+static void usage(const char *name) {
+    cerr << "Usage: " << name << " [options] <rom>..." << endl
+         << "  --list FILE     read more ROM paths from FILE, one per line" << endl
+         << "  --archive FILE  run every ROM of a chip8-pack archive, may be repeated" << endl
+         << "  --seeds N       run every ROM with RNG seeds base .. base + N - 1 (default 1)" << endl
+         << "  --seed-base B   first seed (default 0)" << endl
+         << "  --input FILE    run every ROM and seed with this input script, may be repeated" << endl
+         << "  --frames N      stop after N 60 Hz frames (default " << DEFAULT_FRAMES << ")" << endl
+         << "  --ipf N         instructions per frame (default: the archive's, else " << DEFAULT_IPF << ")" << endl
+         << "  --engine E      interp (reference, default), predecoded, jit or lanes" << endl
+         << "  --mode M        chip8 (default), schip (SUPER-CHIP) or xochip, extended modes run on the interpreter" << endl
+         << "  --quirks Q      compatibility profile: default, vip, chip48, schip or xochip" << endl
+         << "  --lanes N       jobs per lane bundle with --engine lanes (default " << chip8Lanes::MAX_LANES << ")" << endl
+         << "  --threads N     worker threads (default: hardware concurrency)" << endl;
+}
+
+struct inputEvent {
+    long long frame;
+    uint16_t keys;
+};
+
+struct inputScript {
+    string path;
+    vector<inputEvent> events;
+};
+
+struct romImage {
+    string path;
+    vector<uint8_t> storage;    //File contents, empty for ROMs served from an archive mapping
+    const uint8_t *data{};
+    size_t size{};
+    Mode mode{Mode::Chip8};
+    Quirks quirks{Quirks::Default};
+    int ipf{};
+};
+
+struct batchJob {
+    size_t rom;
+    uint32_t seed;
+    int script;                 //-1 when the job runs without input
+};
+
+struct batchResult {
+    long long cycles{};
+    long long frames{};
+    uint64_t hash{};
+    const char *exitReason{"load-error"};
+};
+
+/* Work-stealing pool
+ * Every worker owns a deque of job indices, seeded with a contiguous slice of the job list.
+ * Owners pop from the back, idle workers steal from the front of the other deques.
+ * Jobs never spawn jobs, so a worker that finds every deque empty is done.
+ */
+class workStealingPool {
+    struct worker {
+        mutex lock;
+        deque<size_t> jobs;
+    };
+    vector<unique_ptr<worker>> workers;
+
+    bool pop(size_t self, size_t &job);
+    bool steal(size_t self, size_t &job);
+
+public:
+    explicit workStealingPool(unsigned threads);
+    void run(size_t jobCount, const function<void(size_t)> &task);
+};
+
+workStealingPool::workStealingPool(unsigned threads) {
+    for(unsigned i = 0; i < max(1u, threads); i++)
+        workers.emplace_back(new worker);
+}
+
+// Take the most recently queued job of this worker
+bool workStealingPool::pop(size_t self, size_t &job) {
+    lock_guard<mutex> guard(workers[self]->lock);
+    if(workers[self]->jobs.empty())
+        return false;
+    job = workers[self]->jobs.back();
+    workers[self]->jobs.pop_back();
+    return true;
+}
+
+// Take the oldest job of the first other worker that has one
+bool workStealingPool::steal(size_t self, size_t &job) {
+    for(size_t i = 1; i < workers.size(); i++) {
+        worker &victim = *workers[(self + i) % workers.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if(!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+// Run task(0) .. task(jobCount - 1) on all workers and wait for them to finish
+void workStealingPool::run(size_t jobCount, const function<void(size_t)> &task) {
+    size_t count = workers.size();
+    for(size_t i = 0; i < count; i++) {
+        for(size_t job = jobCount * i / count; job < jobCount * (i + 1) / count; job++)
+            workers[i]->jobs.push_back(job);
+    }
+    vector<thread> threads;
+    for(size_t i = 1; i < count; i++) {
+        threads.emplace_back([this, i, &task] {
+            size_t job;
+            while(pop(i, job) || steal(i, job))
+                task(job);
+        });
+    }
+    size_t job;
+    while(pop(0, job) || steal(0, job))
+        task(job);
+    for(thread &t : threads)
+        t.join();
+}
+
+// Read a whole file, false if it cannot be opened
+static bool readFile(const string &path, vector<uint8_t> &data) {
+    ifstream input(path, ifstream::binary);
+    if(!input) {
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+    data.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    return true;
+}
+
+// Parse an input script, events are sorted by frame
+static bool readScript(const string &path, inputScript &script) {
+    ifstream input(path);
+    if(!input) {
+        cerr << "Could not open input script " << path << endl;
+        return false;
+    }
+    script.path = path;
+    string line;
+    for(int lineNumber = 1; getline(input, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        istringstream fields(line);
+        long long frame;
+        string keys;
+        if(!(fields >> frame)) continue;
+        if(!(fields >> keys) || frame < 0) {
+            cerr << path << ":" << lineNumber << ": expected <frame> <hex key mask>" << endl;
+            return false;
+        }
+        script.events.push_back({frame, uint16_t(strtoul(keys.c_str(), nullptr, 16))});
+    }
+    stable_sort(script.events.begin(), script.events.end(),
+                [](const inputEvent &a, const inputEvent &b) { return a.frame < b.frame; });
+    return true;
+}
+
+// Why a job should stop after this frame, null while it can still make progress
+// extended is set for SUPER-CHIP / XO-CHIP jobs, which address all of memory and can exit with 00FD
+static const char *stopReason(const uint8_t *memory, uint16_t pc, bool keyHeld, bool inputLeft, bool extended = false) {
+    uint16_t mask = extended ? 0xFFFFu : 0x0FFFu;
+    uint16_t opcode = (memory[pc & mask] << 8u) | memory[(pc + 1) & mask];
+    if(extended && opcode == 0x00FDu)
+        return "exit";
+    //Jump to self: nothing can change the display any more
+    if((opcode & 0xF000u) == 0x1000u && (opcode & 0x0FFFu) == pc)
+        return "halted";
+    //Waiting on FX0A with no key held and no input left to come
+    if((opcode & 0xF0FFu) == 0xF00Au && !inputLeft && !keyHeld)
+        return "key-wait";
+    return nullptr;
+}
+
+// Run one job to completion
+static batchResult runJob(const romImage &rom, uint32_t seed, const inputScript *script,
+                          long long maxFrames, Engine engine) {
+    batchResult result;
+    chip8 emulator;
+    emulator.setMode(rom.mode);
+    emulator.setSeed(seed);
+    if(!emulator.loadROM(rom.data, rom.size))
+        return result;
+    emulator.setEngine(engine);
+    emulator.setQuirks(rom.quirks);
+
+    uint8_t *keypad = emulator.getKeypad();
+    size_t nextEvent = 0;
+    result.exitReason = "frame-limit";
+    for(long long frame = 0; frame < maxFrames; frame++) {
+        for(; script && nextEvent < script->events.size() && script->events[nextEvent].frame <= frame; nextEvent++) {
+            for(int key = 0; key < 16; key++)
+                keypad[key] = (script->events[nextEvent].keys >> key) & 1u;
+        }
+        emulator.runFrame(rom.ipf);
+        result.frames++;
+
+        bool keyHeld = any_of(keypad, keypad + 16, [](uint8_t k) { return k != 0; });
+        bool inputLeft = script && nextEvent < script->events.size();
+        if(const char *reason = stopReason(emulator.getMemory(), emulator.getPC(), keyHeld, inputLeft, rom.mode != Mode::Chip8)) {
+            result.exitReason = reason;
+            break;
+        }
+    }
+    result.cycles = (long long)emulator.getCycles();
+    result.hash = emulator.screenHash();
+    return result;
+}
+
+// Run jobs [first, first + count) of one ROM side by side on the lane engine, stopping each lane like runJob
+static void runLaneJobs(const romImage &rom, const vector<batchJob> &jobs, size_t first, size_t count,
+                        const vector<inputScript> &scripts, long long maxFrames, vector<batchResult> &results) {
+    chip8Lanes lanes(count);
+    if(!lanes.loadROM(rom.data, rom.size))
+        return;
+    vector<size_t> nextEvent(count);
+    for(size_t lane = 0; lane < count; lane++) {
+        lanes.setSeed(lane, jobs[first + lane].seed);
+        results[first + lane].exitReason = "frame-limit";
+    }
+    size_t active = count;
+    for(long long frame = 0; frame < maxFrames && active > 0; frame++) {
+        for(size_t lane = 0; lane < count; lane++) {
+            int script = jobs[first + lane].script;
+            for(; script >= 0 && nextEvent[lane] < scripts[script].events.size() && scripts[script].events[nextEvent[lane]].frame <= frame; nextEvent[lane]++)
+                lanes.setKeys(lane, scripts[script].events[nextEvent[lane]].keys);
+        }
+        lanes.runFrame(rom.ipf);
+
+        for(size_t lane = 0; lane < count; lane++) {
+            if(!lanes.isRunning(lane))
+                continue;
+            batchResult &result = results[first + lane];
+            result.frames++;
+            int script = jobs[first + lane].script;
+            bool inputLeft = script >= 0 && nextEvent[lane] < scripts[script].events.size();
+            if(const char *reason = stopReason(lanes.getMemory(lane), lanes.getPC(lane), lanes.getKeys(lane) != 0, inputLeft)) {
+                result.exitReason = reason;
+                lanes.setRunning(lane, false);
+                active--;
+            }
+        }
+    }
+    for(size_t lane = 0; lane < count; lane++) {
+        results[first + lane].cycles = (long long)lanes.getCycles(lane);
+        results[first + lane].hash = lanes.screenHash(lane);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    vector<string> romPaths;
+    vector<unique_ptr<romArchive>> archives;
+    vector<string> archivePaths;
+    vector<string> scriptPaths;
+    long long seeds = 1;
+    uint32_t seedBase = 0;
+    long long frames = DEFAULT_FRAMES;
+    int ipf = 0;
+    unsigned threads = thread::hardware_concurrency();
+    Engine engine = Engine::Interpreter;
+    Mode mode = Mode::Chip8;
+    Quirks quirks = Quirks::Default;
+    bool modeSet = false, quirksSet = false;
+    bool useLanes = false;
+    int laneWidth = chip8Lanes::MAX_LANES;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--list") && i + 1 < argc) {
+            ifstream list(argv[++i]);
+            if(!list) {
+                cerr << "Could not open ROM list " << argv[i] << endl;
+                return 1;
+            }
+            for(string line; getline(list, line); ) {
+                if(!line.empty() && line.back() == '\r') line.pop_back();
+                if(!line.empty() && line[0] != '#') romPaths.push_back(line);
+            }
+        }
+        else if(!strcmp(argv[i], "--archive") && i + 1 < argc) {
+            archives.emplace_back(new romArchive);
+            archivePaths.push_back(argv[++i]);
+            if(!archives.back()->open(argv[i]))
+                return 1;
+        }
+        else if(!strcmp(argv[i], "--seeds") && i + 1 < argc) seeds = atoll(argv[++i]);
+        else if(!strcmp(argv[i], "--seed-base") && i + 1 < argc) seedBase = strtoul(argv[++i], nullptr, 0);
+        else if(!strcmp(argv[i], "--input") && i + 1 < argc) scriptPaths.push_back(argv[++i]);
+        else if(!strcmp(argv[i], "--frames") && i + 1 < argc) frames = atoll(argv[++i]);
+        else if(!strcmp(argv[i], "--ipf") && i + 1 < argc) ipf = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--lanes") && i + 1 < argc) laneWidth = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--engine") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "interp")) engine = Engine::Interpreter;
+            else if(!strcmp(name, "predecoded")) engine = Engine::Predecoded;
+            else if(!strcmp(name, "jit")) engine = Engine::Jit;
+            else if(!strcmp(name, "lanes")) useLanes = true;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--mode") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "chip8")) mode = Mode::Chip8;
+            else if(!strcmp(name, "schip")) mode = Mode::SuperChip;
+            else if(!strcmp(name, "xochip")) mode = Mode::XoChip;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            modeSet = true;
+        }
+        else if(!strcmp(argv[i], "--quirks") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "default")) quirks = Quirks::Default;
+            else if(!strcmp(name, "vip")) quirks = Quirks::Vip;
+            else if(!strcmp(name, "chip48")) quirks = Quirks::Chip48;
+            else if(!strcmp(name, "schip")) quirks = Quirks::SuperChip;
+            else if(!strcmp(name, "xochip")) quirks = Quirks::XoChip;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            quirksSet = true;
+        }
+        else if(argv[i][0] != '-') romPaths.push_back(argv[i]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if((romPaths.empty() && archives.empty()) || seeds <= 0 || frames <= 0 || ipf < 0 || laneWidth < 1 || laneWidth > chip8Lanes::MAX_LANES) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(threads == 0) threads = 1;
+
+    //ROMs and scripts are read once and shared read-only by every job
+    vector<romImage> roms(romPaths.size());
+    for(size_t i = 0; i < romPaths.size(); i++) {
+        roms[i].path = romPaths[i];
+        if(!readFile(romPaths[i], roms[i].storage))
+            return 1;
+        roms[i].data = roms[i].storage.data();
+        roms[i].size = roms[i].storage.size();
+        roms[i].mode = mode;
+        roms[i].quirks = quirks;
+        roms[i].ipf = ipf ? ipf : DEFAULT_IPF;
+    }
+    //Archive ROMs are not copied, jobs load them from the mapping; command line settings override the recorded ones
+    for(size_t a = 0; a < archives.size(); a++) {
+        for(size_t i = 0; i < archives[a]->size(); i++) {
+            const romEntry &entry = archives[a]->entry(i);
+            romImage rom;
+            rom.path = archivePaths[a] + ":" + archives[a]->name(entry);
+            rom.data = archives[a]->data(entry);
+            rom.size = entry.size;
+            rom.mode = modeSet ? mode : Mode(entry.mode);
+            rom.quirks = quirksSet ? quirks : Quirks(entry.quirks);
+            rom.ipf = ipf ? ipf : entry.instructionsPerFrame ? entry.instructionsPerFrame : DEFAULT_IPF;
+            roms.push_back(move(rom));
+        }
+    }
+    vector<inputScript> scripts(scriptPaths.size());
+    for(size_t i = 0; i < scriptPaths.size(); i++) {
+        if(!readScript(scriptPaths[i], scripts[i]))
+            return 1;
+    }
+
+    vector<batchJob> jobs;
+    int scriptCount = max<int>(1, scripts.size());
+    for(size_t rom = 0; rom < roms.size(); rom++) {
+        for(long long seed = 0; seed < seeds; seed++) {
+            for(int script = 0; script < scriptCount; script++)
+                jobs.push_back({rom, uint32_t(seedBase + seed), scripts.empty() ? -1 : script});
+        }
+    }
+    vector<batchResult> results(jobs.size());
+
+    //With lanes, a task is a bundle of consecutive jobs of one ROM, otherwise a single job
+    //ROMs the lane engine cannot run (extended modes, other quirks profiles) get single jobs on the interpreter
+    auto laneRom = [&](size_t rom) { return useLanes && roms[rom].mode == Mode::Chip8 && roms[rom].quirks == Quirks::Default; };
+    vector<pair<size_t, size_t>> tasks;
+    for(size_t first = 0; first < jobs.size(); ) {
+        size_t count = 1;
+        while(laneRom(jobs[first].rom) && count < size_t(laneWidth) && first + count < jobs.size() && jobs[first + count].rom == jobs[first].rom)
+            count++;
+        tasks.push_back({first, count});
+        first += count;
+    }
+
+    auto start = chrono::steady_clock::now();
+    workStealingPool pool(min<size_t>(threads, tasks.size()));
+    pool.run(tasks.size(), [&](size_t index) {
+        size_t first = tasks[index].first;
+        const batchJob &job = jobs[first];
+        if(laneRom(job.rom)) {
+            runLaneJobs(roms[job.rom], jobs, first, tasks[index].second, scripts, frames, results);
+            return;
+        }
+        results[first] = runJob(roms[job.rom], job.seed, job.script < 0 ? nullptr : &scripts[job.script],
+                                frames, engine);
+    });
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    //Records are printed in job order, independent of scheduling
+    long long totalCycles = 0;
+    cout << "rom,seed,input,cycles,frames,hash,exit\n";
+    for(size_t i = 0; i < jobs.size(); i++) {
+        const batchJob &job = jobs[i];
+        const batchResult &result = results[i];
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)result.hash);
+        cout << roms[job.rom].path << "," << job.seed << ","
+             << (job.script < 0 ? "" : scripts[job.script].path) << ","
+             << result.cycles << "," << result.frames << "," << hash << "," << result.exitReason << "\n";
+        totalCycles += result.cycles;
+    }
+    cout.flush();
+    cerr << jobs.size() << " jobs on " << min<size_t>(threads, tasks.size()) << " threads, "
+         << elapsed.count() << " s, "
+         << (elapsed.count() > 0 ? totalCycles / elapsed.count() / 1e6 : 0) << " MIPS" << endl;
+    return 0;
+}
@@ -0,0 +1,335 @@
+#include "../src/CHIP8.hpp"
+#include "../src/lanes.hpp"
+#include "../src/pixels.hpp"
+#if defined(CHIP8_BENCH_GRAPHICS)
+#include "../src/graphics.hpp"
+#endif
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* chip8-bench
+ * Microbenchmarks of the hot paths plus whole-program speed on synthetic ROMs built here,
+ * printed as JSON so runs from different builds can be diffed.
+ *
+ *   dispatch/<engine>        ns per instruction on a straight run of non-branching ALU opcodes
+ *   dxyn/h<N>/<case>         ns per DXYN (interpreter) for sprite heights 1, 8 and 15, drawn
+ *                            byte-aligned, unaligned, wrapping horizontally and wrapping vertically
+ *   rom/<name>/<engine>      MIPS on each synthetic ROM
+ *   rom/<name>/interp-<Q>    MIPS on the interpreter with the vip and schip quirks profiles
+ *   rom/<name>/lanes<N>      MIPS summed over N lockstep lanes with different seeds
+ *   pixels/<stage>           ns per pixel of the pixel pipeline: table expansion of the 64x32
+ *                            display, persistence on it and on the 128x64 planes, 8x scaling
+ *
+ * Built with -DCHIP8_BENCH_GRAPHICS and linked with graphics.cpp and SDL it also measures
+ * updateDisplay, updateHardware and audio sample generation (a window is opened for this)
+ *
+ * Usage: chip8-bench [--time SECONDS] [--filter TEXT] [--out FILE]
+ */
+
+struct benchResult {
+    string name;
+    string unit;
+    double value;
+};
+
+static double minTime{0.2};                    //Seconds each repetition runs for
+static const int REPEATS{3};                    //Best repetition is reported
+static string filter;
+static vector<benchResult> results;
+
+// Time body, which performs opsPerCall operations, and return the best ns per operation
+static double measure(const function<void()> &body, long long opsPerCall) {
+    double best = 1e300;
+    for(int r = 0; r < REPEATS; r++) {
+        long long calls = 0;
+        auto start = chrono::steady_clock::now();
+        chrono::duration<double> elapsed{};
+        do {
+            for(int i = 0; i < 16; i++)
+                body();
+            calls += 16;
+            elapsed = chrono::steady_clock::now() - start;
+        } while(elapsed.count() < minTime);
+        best = min(best, elapsed.count() * 1e9 / (calls * opsPerCall));
+    }
+    return best;
+}
+
+// Run a benchmark unless it is filtered out, recording ns per operation
+static void benchNs(const string &name, long long opsPerCall, const function<void()> &body) {
+    if(!filter.empty() && name.find(filter) == string::npos)
+        return;
+    results.push_back({name, "ns/op", measure(body, opsPerCall)});
+    cerr << name << ": " << results.back().value << " ns/op" << endl;
+}
+
+// Run a benchmark unless it is filtered out, recording millions of instructions per second
+static void benchMips(const string &name, long long instructionsPerCall, const function<void()> &body) {
+    if(!filter.empty() && name.find(filter) == string::npos)
+        return;
+    results.push_back({name, "MIPS", 1e3 / measure(body, instructionsPerCall)});
+    cerr << name << ": " << results.back().value << " MIPS" << endl;
+}
+
+//Synthetic ROM assembly, one 16-bit word per instruction starting at 0x200
+struct romBuilder {
+    vector<uint16_t> words;
+
+    uint16_t here() const { return 0x200 + 2 * words.size(); }
+    romBuilder &op(uint16_t word) { words.push_back(word); return *this; }
+    void patch(uint16_t address, uint16_t word) { words[(address - 0x200) / 2] = word; }
+    void place(uint16_t address, const vector<uint8_t> &bytes) {
+        while(here() < address) words.push_back(0);
+        for(size_t i = 0; i < bytes.size(); i += 2)
+            words.push_back((bytes[i] << 8) | (i + 1 < bytes.size() ? bytes[i + 1] : 0));
+    }
+    vector<uint8_t> image() const {
+        vector<uint8_t> bytes;
+        for(uint16_t word : words) {
+            bytes.push_back(word >> 8);
+            bytes.push_back(word & 0xFF);
+        }
+        return bytes;
+    }
+};
+
+// Straight-line ALU code that never branches, looped with one jump: measures pure dispatch
+static vector<uint8_t> dispatchRom(int &loopLength) {
+    static const uint16_t body[] = {0x6012, 0x7103, 0x8204, 0x8315, 0x8426, 0x850E, 0x8611, 0x8722,
+                                    0x8833, 0x8907, 0xA300, 0xF11E, 0x6A7F, 0x7BFF, 0x8CA0, 0x8DB4};
+    romBuilder rom;
+    for(int i = 0; i < 64; i++)
+        rom.op(body[i % 16]);
+    rom.op(0x1200);
+    loopLength = 65;
+    return rom.image();
+}
+
+// 64 DXYN of one height at one position, looped: VX = x, VY = y, I = 15 bytes of sprite data at 0x300
+static vector<uint8_t> spriteRom(int height, int x, int y, int &loopLength) {
+    romBuilder rom;
+    rom.op(0x6000 | x).op(0x6100 | y).op(0xA300);
+    uint16_t loop = rom.here();
+    for(int i = 0; i < 64; i++)
+        rom.op(0xD010 | height);
+    rom.op(0x1000 | loop);
+    rom.place(0x300, {0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x3C, 0x42, 0x99, 0xA5, 0x99, 0x42, 0x3C});
+    loopLength = 65;
+    return rom.image();
+}
+
+// Whole-program workloads, each loops forever
+static vector<pair<string, vector<uint8_t>>> syntheticRoms() {
+    vector<pair<string, vector<uint8_t>>> roms;
+
+    //alu: counted inner loop of arithmetic, skips and a back branch
+    {
+        romBuilder rom;
+        rom.op(0x6000);
+        uint16_t loop = rom.here();
+        rom.op(0x7001).op(0x8104).op(0x8215).op(0x8316).op(0x841E).op(0x8503).op(0x8612)
+           .op(0x4000).op(0x6700).op(0x30FF).op(0x1000 | loop).op(0x6000).op(0x1000 | loop);
+        roms.push_back({"alu", rom.image()});
+    }
+    //sprites: walks the font glyphs over the screen, clearing it every 256 draws
+    {
+        romBuilder rom;
+        rom.op(0x00E0).op(0x6000).op(0x6100).op(0x6200).op(0x6300);
+        uint16_t loop = rom.here();
+        rom.op(0xF029).op(0xD125).op(0x7105).op(0x7203).op(0x7001).op(0x6F0F).op(0x80F2)
+           .op(0x7301).op(0x3300).op(0x1000 | loop).op(0x00E0).op(0x1000 | loop);
+        roms.push_back({"sprites", rom.image()});
+    }
+    //calls: nested subroutine calls and returns
+    {
+        romBuilder rom;
+        uint16_t loop = rom.here();
+        rom.op(0x2000).op(0x7001).op(0x1000 | loop);
+        uint16_t outer = rom.here();
+        rom.op(0x2000).op(0x7101).op(0x2000).op(0x00EE);
+        uint16_t inner = rom.here();
+        rom.op(0x8214).op(0x00EE);
+        rom.patch(loop, 0x2000 | outer);
+        rom.patch(outer, 0x2000 | inner);
+        rom.patch(outer + 4, 0x2000 | inner);
+        roms.push_back({"calls", rom.image()});
+    }
+    //memory: BCD and register block stores/loads into a data area away from the code
+    {
+        romBuilder rom;
+        uint16_t loop = rom.here();
+        rom.op(0x7037).op(0xA800).op(0xF033).op(0xF265).op(0xA810).op(0xF755).op(0xA810).op(0xF765)
+           .op(0x1000 | loop);
+        roms.push_back({"memory", rom.image()});
+    }
+    //mixed: random numbers, timers, draws and arithmetic in one loop
+    {
+        romBuilder rom;
+        rom.op(0x6A3C).op(0xFA15);
+        uint16_t loop = rom.here();
+        rom.op(0xC33F).op(0xC41F).op(0xF329).op(0xD345).op(0x8534).op(0x8656).op(0xFB07).op(0x3B00)
+           .op(0x1000 | loop).op(0xFA15).op(0x00E0).op(0x1000 | loop);
+        roms.push_back({"mixed", rom.image()});
+    }
+    return roms;
+}
+
+static const pair<const char*, Engine> ENGINES[] = {
+    {"interp", Engine::Interpreter}, {"predecoded", Engine::Predecoded}, {"jit", Engine::Jit}
+};
+
+#if defined(__VERSION__)
+static const char *COMPILER{__VERSION__};
+#else
+static const char *COMPILER{"unknown"};
+#endif
+
+// Print results as JSON to out
+static void writeJson(FILE *out) {
+    fprintf(out, "{\n  \"compiler\": \"%s\",\n  \"benchmarks\": [\n", COMPILER);
+    for(size_t i = 0; i < results.size(); i++) {
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.4f}%s\n", results[i].name.c_str(),
+                results[i].unit.c_str(), results[i].value, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *outPath = nullptr;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--time") && i + 1 < argc) minTime = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--filter") && i + 1 < argc) filter = argv[++i];
+        else if(!strcmp(argv[i], "--out") && i + 1 < argc) outPath = argv[++i];
+        else {
+            cerr << "Usage: " << argv[0] << " [--time SECONDS] [--filter TEXT] [--out FILE]" << endl;
+            return 1;
+        }
+    }
+
+    //Instruction dispatch, one loop of the dispatch ROM per call
+    int loopLength;
+    vector<uint8_t> rom = dispatchRom(loopLength);
+    for(const auto &engine : ENGINES) {
+        chip8 emulator;
+        emulator.loadROM(rom.data(), rom.size());
+        emulator.setEngine(engine.second);
+        if(engine.second == Engine::Interpreter)
+            benchNs(string("dispatch/") + engine.first, loopLength, [&] { for(int i = 0; i < loopLength; i++) emulator.emulateCycle(); });
+        else
+            benchNs(string("dispatch/") + engine.first, loopLength, [&] { emulator.runCycles(loopLength); });
+    }
+
+    //Sprite drawing
+    static const struct { const char *name; int x; int y; } CASES[] = {
+        {"aligned", 8, 4}, {"unaligned", 3, 4}, {"hwrap", 60, 4}, {"vwrap", 8, 28}
+    };
+    for(int height : {1, 8, 15}) {
+        for(const auto &c : CASES) {
+            vector<uint8_t> sprites = spriteRom(height, c.x, c.y, loopLength);
+            chip8 emulator;
+            emulator.loadROM(sprites.data(), sprites.size());
+            emulator.runCycles(3);
+            benchNs("dxyn/h" + to_string(height) + "/" + c.name, loopLength,
+                    [&] { for(int i = 0; i < loopLength; i++) emulator.emulateCycle(); });
+        }
+    }
+
+    //Whole programs, one 60 Hz frame's worth of a fast machine per call
+    static const int CALL_CYCLES{10000};
+    for(const auto &program : syntheticRoms()) {
+        for(const auto &engine : ENGINES) {
+            chip8 emulator;
+            emulator.setSeed(1);
+            emulator.loadROM(program.second.data(), program.second.size());
+            emulator.setEngine(engine.second);
+            benchMips("rom/" + program.first + "/" + engine.first, CALL_CYCLES, [&] { emulator.runFrame(CALL_CYCLES); });
+        }
+        for(const auto &profile : {make_pair("vip", Quirks::Vip), make_pair("schip", Quirks::SuperChip)}) {
+            chip8 emulator;
+            emulator.setSeed(1);
+            emulator.loadROM(program.second.data(), program.second.size());
+            emulator.setQuirks(profile.second);
+            benchMips("rom/" + program.first + "/interp-" + profile.first, CALL_CYCLES, [&] { emulator.runFrame(CALL_CYCLES); });
+        }
+        for(int width : {8, 32}) {
+            chip8Lanes lanes(width);
+            lanes.loadROM(program.second.data(), program.second.size());
+            for(int lane = 0; lane < width; lane++)
+                lanes.setSeed(lane, lane + 1);
+            int laneCycles = CALL_CYCLES / width;
+            benchMips("rom/" + program.first + "/lanes" + to_string(width), laneCycles * width,
+                      [&] { lanes.runFrame(laneCycles); });
+        }
+    }
+
+    //Pixel pipeline, one whole display per call
+    {
+        pixelPipeline pipeline;
+        uint64_t screen[32];
+        uint64_t planes[2][64][2];
+        uint64_t pattern = 0x9E3779B97F4A7C15ull;
+        for(int i = 0; i < 32; i++)
+            screen[i] = pattern *= 0xBF58476D1CE4E5B9ull;
+        for(auto &plane : planes)
+            for(auto &row : plane)
+                for(uint64_t &word : row)
+                    word = pattern *= 0xBF58476D1CE4E5B9ull;
+        vector<uint32_t> frame(128 * 64), scaled;
+        uint8_t *pixels = reinterpret_cast<uint8_t*>(frame.data());
+        benchNs("pixels/expand", 64 * 32, [&] { screen[0] ^= 1; pipeline.expandRows(screen, 0, 32, pixels, 64 * 4); });
+        pipeline.setPersistence(0.75f);
+        benchNs("pixels/persistence", 64 * 32, [&] { screen[0] = ~screen[0]; pipeline.expandRows(screen, 0, 32, pixels, 64 * 4); });
+        benchNs("pixels/planes-persistence", 128 * 64,
+                [&] { planes[0][0][0] = ~planes[0][0][0]; pipeline.expandPlaneRows(planes, 0, 64, pixels, 128 * 4); });
+        benchNs("pixels/scale8", 64 * 32, [&] { pixelPipeline::scale(frame.data(), 64, 32, 8, scaled); });
+    }
+
+#if defined(CHIP8_BENCH_GRAPHICS)
+    {
+        Graphics display;
+        uint64_t screen[32];
+        uint64_t pattern = 0x9E3779B97F4A7C15ull;
+        for(int i = 0; i < 32; i++)
+            screen[i] = pattern *= 0xBF58476D1CE4E5B9ull;
+        benchNs("updateDisplay/all-rows", 1, [&] { screen[0] ^= 1; display.updateDisplay(screen, 0xFFFFFFFFu); });
+        benchNs("updateDisplay/one-row", 1, [&] { screen[7] ^= 1; display.updateDisplay(screen, 1u << 7); });
+
+        uint8_t registers[16] = {};
+        uint16_t stack[16] = {};
+        uint16_t pc = 0x200;
+        benchNs("updateHardware/unchanged", 1, [&] { display.updateHardware(registers, stack, pc); });
+        benchNs("updateHardware/one-register", 1, [&] { registers[3]++; display.updateHardware(registers, stack, pc); });
+        benchNs("updateHardware/all", 1, [&] {
+            for(int i = 0; i < 16; i++) { registers[i]++; stack[i]++; }
+            pc += 2;
+            display.updateHardware(registers, stack, pc);
+        });
+
+        float samples[512];
+        display.setBeep(true);
+        benchNs("audio/beep-512", 512, [&] { display.generateSamples(samples, 512); });
+        display.setBeep(false);
+        benchNs("audio/silence-512", 512, [&] { display.generateSamples(samples, 512); });
+    }
+#endif
+
+    if(outPath) {
+        FILE *out = fopen(outPath, "w");
+        if(!out) {
+            cerr << "Could not open " << outPath << endl;
+            return 1;
+        }
+        writeJson(out);
+        fclose(out);
+    } else {
+        writeJson(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include "../src/CHIP8.hpp"
+#include "../src/inputlog.hpp"
+#include "../src/pixels.hpp"
+#include "../src/profiler.hpp"
+#include "../src/romarchive.hpp"
+#include "../src/telemetry.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+/* chip8-headless
+ * Runs a ROM on the emulation core without SDL: no window, no font, no audio device
+ * Executes a fixed number of cycles (instructions) or frames as fast as the host allows
+ *
+ * With --replay, re-runs a session recorded by the SDL frontend (same mode, quirks, seed, ipf and key changes)
+ *
+ * With --archive, <rom> is the name or 16-digit hex hash of a ROM in a chip8-pack archive, run with the
+ * mode, quirks profile and instructions per frame recorded for it unless they are given
+ *
+ * With --profile, samples the pc and call stack, writes folded stacks for a flamegraph and prints
+ * the hottest addresses
+ *
+ * With --dump, writes the display as a PPM image through the same pixel pipeline as the window
+ * (palette, persistence), enlarged --scale times: the final frame, or every frame when the file
+ * name contains a printf frame number such as frame%05d.ppm
+ *
+ * Usage: chip8-headless <rom> [--cycles N | --frames N | --replay FILE] [--ipf N] [--seed N] [--engine interp|predecoded|jit] [--screen]
+ *                       [--mode chip8|schip|xochip] [--quirks PROFILE] [--archive FILE] [--telemetry FILE] [--profile FILE] [--profile-interval N] [--hotspots N]
+ *                       [--dump FILE] [--scale N] [--palette PALETTE] [--persistence F]
+ */
+
+static const int DEFAULT_IPF{11};
+static const int DEFAULT_PROFILE_INTERVAL{97};      //Prime, so samples do not lock onto loops of even length
+static const int DEFAULT_SCALE{8};
+
+// Print usage to stderr
+static void usage(const char *name) {
+    cerr << "Usage: " << name << " <rom> [--cycles N | --frames N | --replay FILE] [--ipf N] [--seed N] [--engine interp|predecoded|jit] [--screen] [--telemetry FILE]" << endl
+         << "       [--mode chip8|schip|xochip] [--quirks PROFILE] [--archive FILE] [--profile FILE] [--profile-interval N] [--hotspots N]" << endl
+         << "       [--dump FILE] [--scale N] [--palette PALETTE] [--persistence F]" << endl
+         << "  --cycles N     execute N instructions (timers tick every ipf instructions)" << endl
+         << "  --frames N     execute N 60 Hz frames of ipf instructions each" << endl
+         << "  --replay FILE  re-run a recorded input log, its mode, quirks, seed and ipf override the options" << endl
+         << "  --ipf N        instructions per frame (default " << DEFAULT_IPF << ")" << endl
+         << "  --seed N       seed for the CXNN random numbers (default: random)" << endl
+         << "  --engine E     interp (reference, default), predecoded or jit" << endl
+         << "  --screen       print the final display as text" << endl
+         << "  --mode M       chip8 (default), schip (SUPER-CHIP) or xochip, extended modes run on the interpreter" << endl
+         << "  --quirks Q     compatibility profile: default, vip, chip48, schip or xochip" << endl
+         << "  --archive F    load <rom>, a name or hex hash, from a chip8-pack archive with its recorded settings" << endl
+         << "  --telemetry F  write opcode counts and frame timings to F as JSON" << endl
+         << "  --profile F    sample pc and call stack, write folded stacks to F and print the hot spots" << endl
+         << "  --profile-interval N  instructions between samples (default " << DEFAULT_PROFILE_INTERVAL << ")" << endl
+         << "  --hotspots N   addresses in the hot-spot table (default 20)" << endl
+         << "  --dump FILE    write the final display as a PPM image, every frame if FILE has a %d frame number" << endl
+         << "  --scale N      enlarge dumped images N times (default " << DEFAULT_SCALE << ")" << endl
+         << "  --palette P    dump colours: default, mono, green, amber, lcd or RRGGBB,RRGGBB[,RRGGBB,RRGGBB]" << endl
+         << "  --persistence F  unlit pixels keep the fraction F of their brightness per dumped frame (default 0)" << endl;
+}
+
+// Print the 64x32 display, '#' for set pixels
+static void printScreen(const uint64_t *screen) {
+    for(int i = 0; i < 32; i++) {
+        string line(64, '.');
+        for(int j = 0; j < 64; j++) {
+            if((screen[i] >> (63 - j)) & 1u) line[j] = '#';
+        }
+        cout << line << "\n";
+    }
+}
+
+// Print the 128x64 SUPER-CHIP / XO-CHIP display, '#' for plane 1, '+' for plane 2 and '@' for both
+static void printPlanes(const uint64_t planes[2][64][2]) {
+    static const char SHADES[4] = {'.', '#', '+', '@'};
+    for(int i = 0; i < 64; i++) {
+        string line(128, '.');
+        for(int j = 0; j < 128; j++) {
+            int shift = 63 - (j & 63);
+            int colour = ((planes[0][i][j >> 6] >> shift) & 1u) | (((planes[1][i][j >> 6] >> shift) & 1u) << 1);
+            line[j] = SHADES[colour];
+        }
+        cout << line << "\n";
+    }
+}
+
+// Convert the whole display through the pixel pipeline, one frame of persistence, returns the width
+static int renderFrame(pixelPipeline &pipeline, const chip8 &emulator, vector<uint32_t> &frame) {
+    bool extended = emulator.getMode() != Mode::Chip8;
+    int width = extended ? 128 : 64, height = extended ? 64 : 32;
+    frame.resize(size_t(width) * height);
+    uint8_t *pixels = reinterpret_cast<uint8_t*>(frame.data());
+    if(extended)
+        pipeline.expandPlaneRows(emulator.getPlanes(), 0, height, pixels, width * 4);
+    else
+        pipeline.expandRows(emulator.getScreen(), 0, height, pixels, width * 4);
+    return width;
+}
+
+// Write a frame from renderFrame, enlarged scale times, as a binary PPM
+static bool writeFrame(const char *path, const vector<uint32_t> &frame, int width, int scale) {
+    int height = int(frame.size()) / width;
+    vector<uint32_t> scaled;
+    pixelPipeline::scale(frame.data(), width, height, scale, scaled);
+    vector<uint8_t> rgb(scaled.size() * 3);
+    for(size_t i = 0; i < scaled.size(); i++) {
+        rgb[3 * i] = uint8_t(scaled[i] >> 24);
+        rgb[3 * i + 1] = uint8_t(scaled[i] >> 16);
+        rgb[3 * i + 2] = uint8_t(scaled[i] >> 8);
+    }
+    FILE *file = fopen(path, "wb");
+    if(!file) {
+        cerr << "Could not open dump file " << path << endl;
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width * scale, height * scale);
+    bool written = fwrite(rgb.data(), rgb.size(), 1, file) == 1;
+    written = (fclose(file) == 0) && written;
+    if(!written)
+        cerr << "Could not write dump file " << path << endl;
+    return written;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *romPath = nullptr;
+    long long cycles = 0;
+    long long frames = 0;
+    int ipf = 0;
+    bool showScreen = false;
+    const char *replayPath = nullptr;
+    const char *archivePath = nullptr;
+    const char *telemetryPath = nullptr;
+    const char *profilePath = nullptr;
+    long long profileInterval = DEFAULT_PROFILE_INTERVAL;
+    int hotSpots = 20;
+    bool seeded = false;
+    uint32_t seed = 0;
+    Engine engine = Engine::Interpreter;
+    Mode mode = Mode::Chip8;
+    Quirks quirks = Quirks::Default;
+    bool modeSet = false, quirksSet = false;
+    const char *dumpPath = nullptr;
+    int scale = DEFAULT_SCALE;
+    palette colours = DEFAULT_PALETTE;
+    float persistence = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--cycles") && i + 1 < argc) cycles = atoll(argv[++i]);
+        else if(!strcmp(argv[i], "--frames") && i + 1 < argc) frames = atoll(argv[++i]);
+        else if(!strcmp(argv[i], "--ipf") && i + 1 < argc) ipf = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--screen")) showScreen = true;
+        else if(!strcmp(argv[i], "--replay") && i + 1 < argc) replayPath = argv[++i];
+        else if(!strcmp(argv[i], "--archive") && i + 1 < argc) archivePath = argv[++i];
+        else if(!strcmp(argv[i], "--telemetry") && i + 1 < argc) telemetryPath = argv[++i];
+        else if(!strcmp(argv[i], "--profile") && i + 1 < argc) profilePath = argv[++i];
+        else if(!strcmp(argv[i], "--profile-interval") && i + 1 < argc) profileInterval = atoll(argv[++i]);
+        else if(!strcmp(argv[i], "--hotspots") && i + 1 < argc) hotSpots = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--dump") && i + 1 < argc) dumpPath = argv[++i];
+        else if(!strcmp(argv[i], "--scale") && i + 1 < argc) scale = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--persistence") && i + 1 < argc) persistence = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--palette") && i + 1 < argc) {
+            if(!parsePalette(argv[++i], colours))
+                return 1;
+        }
+        else if(!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+            seeded = true;
+        }
+        else if(!strcmp(argv[i], "--engine") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "interp")) engine = Engine::Interpreter;
+            else if(!strcmp(name, "predecoded")) engine = Engine::Predecoded;
+            else if(!strcmp(name, "jit")) engine = Engine::Jit;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--mode") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "chip8")) mode = Mode::Chip8;
+            else if(!strcmp(name, "schip")) mode = Mode::SuperChip;
+            else if(!strcmp(name, "xochip")) mode = Mode::XoChip;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            modeSet = true;
+        }
+        else if(!strcmp(argv[i], "--quirks") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "default")) quirks = Quirks::Default;
+            else if(!strcmp(name, "vip")) quirks = Quirks::Vip;
+            else if(!strcmp(name, "chip48")) quirks = Quirks::Chip48;
+            else if(!strcmp(name, "schip")) quirks = Quirks::SuperChip;
+            else if(!strcmp(name, "xochip")) quirks = Quirks::XoChip;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            quirksSet = true;
+        }
+        else if(argv[i][0] != '-' && !romPath) romPath = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(!romPath || ipf < 0 || profileInterval <= 0 || hotSpots < 0 || scale <= 0 || scale > 64 || persistence < 0 || persistence >= 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    //A ROM from an archive is found by name, or by content hash, and brings its recorded settings
+    romArchive archive;
+    const romEntry *archived = nullptr;
+    if(archivePath) {
+        if(!archive.open(archivePath))
+            return 1;
+        archived = archive.findName(romPath);
+        char *end;
+        uint64_t hash = strtoull(romPath, &end, 16);
+        if(!archived && strlen(romPath) == 16 && *end == '\0')
+            archived = archive.findHash(hash);
+        if(!archived) {
+            cerr << "No ROM " << romPath << " in " << archivePath << endl;
+            return 1;
+        }
+        if(!modeSet) mode = Mode(archived->mode);
+        if(!quirksSet) quirks = Quirks(archived->quirks);
+        if(!ipf) ipf = archived->instructionsPerFrame;
+    }
+    if(!ipf) ipf = DEFAULT_IPF;
+    inputLog replay;
+    if(replayPath) {
+        if(!replay.load(replayPath))
+            return 1;
+        ipf = replay.instructionsPerFrame;
+        mode = replay.mode;
+        quirks = replay.quirks;
+        cycles = replay.endCycle;
+    }
+    if(cycles <= 0 && frames <= 0) frames = 600;
+    if(cycles <= 0) cycles = frames * ipf;
+
+    chip8 emulator;
+    emulator.setMode(mode);
+    if(archived ? !emulator.loadROM(archive.data(*archived), archived->size) : !emulator.loadROM(romPath))
+        return 1;
+    emulator.setEngine(engine);
+    emulator.setQuirks(quirks);
+    if(seeded)
+        emulator.setSeed(seed);
+    unique_ptr<telemetry> stats;
+    if(telemetryPath) {
+        stats.reset(new telemetry(telemetryPath));
+        emulator.setOpcodeCounters(stats->opcodeCounters());
+        stats->setMode(emulator.getMode());
+    }
+    unique_ptr<profiler> profile;
+    if(profilePath)
+        profile.reset(new profiler(profileInterval));
+    //Persistence fades over frames, so the pipeline sees every frame whenever a dump is written
+    unique_ptr<pixelPipeline> pipeline;
+    vector<uint32_t> frame;
+    int frameWidth = 0;
+    const char *frameNumber = dumpPath ? strchr(dumpPath, '%') : nullptr;
+    bool dumpEveryFrame = frameNumber != nullptr;
+    if(frameNumber) {
+        size_t digits = strspn(frameNumber + 1, "0123456789");
+        if(frameNumber[1 + digits] != 'd' || strchr(frameNumber + 2 + digits, '%')) {
+            cerr << "Dump file name must contain one %d (or %0Nd) frame number" << endl;
+            return 1;
+        }
+    }
+    if(dumpPath) {
+        pipeline.reset(new pixelPipeline);
+        pipeline->setPalette(colours);
+        pipeline->setPersistence(persistence);
+    }
+
+    auto start = chrono::steady_clock::now();
+    if(replayPath && !replayInputLog(emulator, replay, profile.get()))
+        return 1;
+    for(long long executed = emulator.getCycles(); executed < cycles; ) {
+        long long batch = min<long long>(ipf, cycles - executed);
+        auto frameStart = stats ? chrono::steady_clock::now() : chrono::steady_clock::time_point{};
+        if(profile && batch == ipf)
+            profile->runFrame(emulator, ipf);
+        else if(profile)
+            profile->run(emulator, batch);
+        else if(batch == ipf)
+            emulator.runFrame(ipf);
+        else
+            emulator.runCycles(batch);
+        if(stats)
+            stats->recordFrame(batch, chrono::steady_clock::now() - frameStart);
+        executed += batch;
+        if(pipeline && batch == ipf)
+            frameWidth = renderFrame(*pipeline, emulator, frame);
+        if(dumpEveryFrame && batch == ipf) {
+            char name[4096];
+            snprintf(name, sizeof(name), dumpPath, int(executed / ipf));
+            if(!writeFrame(name, frame, frameWidth, scale))
+                return 1;
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    if(pipeline && !dumpEveryFrame) {
+        if(!frameWidth || cycles % ipf)
+            frameWidth = renderFrame(*pipeline, emulator, frame);
+        if(!writeFrame(dumpPath, frame, frameWidth, scale))
+            return 1;
+    }
+
+    if(showScreen && mode != Mode::Chip8)
+        printPlanes(emulator.getPlanes());
+    else if(showScreen)
+        printScreen(emulator.getScreen());
+    cout << "cycles: " << cycles << "\n"
+         << "frames: " << cycles / ipf << "\n"
+         << "screen hash: " << hex << emulator.screenHash() << dec << "\n"
+         << "seconds: " << elapsed.count() << "\n"
+         << "MIPS: " << (elapsed.count() > 0 ? cycles / elapsed.count() / 1e6 : 0) << endl;
+    if(stats && !stats->writeJson())
+        return 1;
+    if(profile) {
+        cout << "\n";
+        profile->printHotSpots(emulator, hotSpots);
+        if(!profile->writeFolded(profilePath))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include "../src/CHIP8.hpp"
+#include "../src/disasm.hpp"
+#include "../src/inputlog.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+/* chip8-lockstep
+ * Differential test of an engine against the reference interpreter: both machines run the same
+ * ROM, seed and input in lockstep and their full state (registers, I, pc, sp, stack, timers,
+ * keypad, memory, display, RNG) is compared after every instruction or every frame.
+ *
+ * In frame mode a divergent frame is re-run from save-states one instruction at a time, so the
+ * report always names the first instruction whose result differs, with its disassembly.
+ *
+ * --case runs a ROM assembled here instead of a file, each one aimed at a corner where engines
+ * have disagreed before.
+ *
+ * Usage: chip8-lockstep <rom | --case NAME> [--engine predecoded|jit] [--step instruction|frame] [--frames N]
+ *                       [--ipf N] [--seed N] [--input FILE]
+ * Exits with 0 when the engines agree, 2 on divergence
+ */
+
+static const int DEFAULT_IPF{11};
+
+// ROM image of instruction words loaded from 0x200
+static vector<uint8_t> assemble(const vector<uint16_t> &words) {
+    vector<uint8_t> bytes;
+    for(uint16_t word : words) {
+        bytes.push_back(word >> 8);
+        bytes.push_back(word & 0xFF);
+    }
+    return bytes;
+}
+
+// BNNN to V0 + NNN = 0x1000, pc leaves the 4 KB and wraps to 0x000, where FX55 stored a jump back to the loop
+static vector<uint8_t> bnnnWrapRom() {
+    return assemble({0x6012, 0x6108, 0xA000, 0xF155, 0x7201, 0x60FF, 0xBF01});
+}
+
+// Straight-line code up to 0xFFE, pc runs off the end of memory into the same jump back at 0x000
+static vector<uint8_t> runOffEndRom() {
+    vector<uint16_t> words{0x6012, 0x6108, 0xA000, 0xF155};
+    words.resize((4096 - 0x200) / 2, 0x7201);
+    return assemble(words);
+}
+
+//Built-in ROMs for --case
+static const struct {
+    const char *name;
+    vector<uint8_t> (*build)();
+} CASES[] = {
+    {"bnnn-wrap", bnnnWrapRom},
+    {"run-off-end", runOffEndRom},
+};
+
+// Print usage to stderr
+static void usage(const char *name) {
+    cerr << "Usage: " << name << " <rom | --case NAME> [--engine predecoded|jit] [--step instruction|frame] [--frames N] [--ipf N] [--seed N] [--input FILE]" << endl
+         << "  --case NAME    run a built-in ROM instead of a file: bnnn-wrap or run-off-end" << endl
+         << "  --engine E     engine checked against the reference interpreter (default jit)" << endl
+         << "  --step S       compare after every instruction (default) or every frame" << endl
+         << "  --frames N     60 Hz frames to run (default 600)" << endl
+         << "  --ipf N        instructions per frame (default " << DEFAULT_IPF << ")" << endl
+         << "  --seed N       seed for the CXNN random numbers (default 0)" << endl
+         << "  --input FILE   drive both machines from an input log, its mode, quirks, seed and ipf are used" << endl;
+}
+
+// Machine state as compared: the opcode latch is scratch that only the interpreter keeps current
+static chip8State comparable(const chip8 &emulator) {
+    chip8State state;
+    emulator.saveState(state);
+    state.opcode = 0;
+    return state;
+}
+
+// Whether two snapshots are identical, over the bytes their mode uses
+static bool sameState(const chip8State &a, const chip8State &b) {
+    return a.size == b.size && memcmp(&a, &b, a.size) == 0;
+}
+
+// Print every field that differs between the reference and the tested engine
+static void reportFields(const chip8State &a, const chip8State &b) {
+    for(int i = 0; i < 16; i++) {
+        if(a.registers[i] != b.registers[i])
+            printf("  V%X: reference 0x%02X, engine 0x%02X\n", i, a.registers[i], b.registers[i]);
+    }
+    if(a.indreg != b.indreg) printf("  I: reference 0x%03X, engine 0x%03X\n", a.indreg, b.indreg);
+    if(a.pc != b.pc) printf("  pc: reference 0x%03X, engine 0x%03X\n", a.pc, b.pc);
+    if(a.sp != b.sp) printf("  sp: reference %u, engine %u\n", a.sp, b.sp);
+    for(int i = 0; i < 16; i++) {
+        if(a.stack[i] != b.stack[i])
+            printf("  stack[%d]: reference 0x%03X, engine 0x%03X\n", i, a.stack[i], b.stack[i]);
+    }
+    if(a.delay != b.delay) printf("  delay timer: reference %u, engine %u\n", a.delay, b.delay);
+    if(a.soundTimer != b.soundTimer) printf("  sound timer: reference %u, engine %u\n", a.soundTimer, b.soundTimer);
+    for(int i = 0; i < 16; i++) {
+        if(a.keypad[i] != b.keypad[i]) printf("  key %X: reference %u, engine %u\n", i, a.keypad[i], b.keypad[i]);
+    }
+    int shown = 0;
+    for(int i = 0; i < 4096; i++) {
+        if(a.memory[i] != b.memory[i] && shown++ < 16)
+            printf("  memory[0x%03X]: reference 0x%02X, engine 0x%02X\n", i, a.memory[i], b.memory[i]);
+    }
+    if(shown > 16) printf("  ... %d more memory bytes differ\n", shown - 16);
+    for(int i = 0; i < 32; i++) {
+        if(a.screen[i] != b.screen[i])
+            printf("  display row %d: reference %016llx, engine %016llx\n", i,
+                   (unsigned long long)a.screen[i], (unsigned long long)b.screen[i]);
+    }
+    if(a.rng != b.rng) printf("  random number generator state differs\n");
+    if(a.cycles != b.cycles) printf("  cycles: reference %llu, engine %llu\n",
+                                    (unsigned long long)a.cycles, (unsigned long long)b.cycles);
+}
+
+// Byte of a snapshot's memory, addresses wrap at 4 KB outside XO-CHIP
+static uint8_t memoryByte(const chip8State &state, unsigned address) {
+    address &= Mode(state.mode) == Mode::XoChip ? 0xFFFFu : 0x0FFFu;
+    return address < 4096 ? state.memory[address] : state.highMemory[address - 4096];
+}
+
+// Report the divergence caused by the instruction the reference ran at pc
+static void reportDivergence(const chip8State &before, const chip8 &reference, const chip8 &engine) {
+    uint16_t pc = Mode(before.mode) == Mode::XoChip ? before.pc : before.pc & 0x0FFFu;
+    uint16_t opcode = (memoryByte(before, pc) << 8u) | memoryByte(before, pc + 1);
+    uint16_t next = (memoryByte(before, pc + 2) << 8u) | memoryByte(before, pc + 3);
+    printf("divergence at cycle %llu\n", (unsigned long long)before.cycles);
+    printf("  0x%03X: %04X  %s\n", pc, opcode, disassemble(opcode, Mode(before.mode), reference.getQuirks(), next).c_str());
+    reportFields(comparable(reference), comparable(engine));
+}
+
+// Set both keypads from a 16-bit mask
+static void applyKeys(chip8 &a, chip8 &b, uint16_t keys) {
+    for(int i = 0; i < 16; i++) {
+        a.getKeypad()[i] = (keys >> i) & 1u;
+        b.getKeypad()[i] = (keys >> i) & 1u;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *romPath = nullptr;
+    const char *caseName = nullptr;
+    const char *inputPath = nullptr;
+    Engine engine = Engine::Jit;
+    bool perInstruction = true;
+    long long frames = 600;
+    int ipf = DEFAULT_IPF;
+    uint32_t seed = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--frames") && i + 1 < argc) frames = atoll(argv[++i]);
+        else if(!strcmp(argv[i], "--ipf") && i + 1 < argc) ipf = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--seed") && i + 1 < argc) seed = strtoul(argv[++i], nullptr, 0);
+        else if(!strcmp(argv[i], "--input") && i + 1 < argc) inputPath = argv[++i];
+        else if(!strcmp(argv[i], "--case") && i + 1 < argc) caseName = argv[++i];
+        else if(!strcmp(argv[i], "--step") && i + 1 < argc) {
+            const char *step = argv[++i];
+            if(!strcmp(step, "instruction")) perInstruction = true;
+            else if(!strcmp(step, "frame")) perInstruction = false;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--engine") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if(!strcmp(name, "predecoded")) engine = Engine::Predecoded;
+            else if(!strcmp(name, "jit")) engine = Engine::Jit;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if(argv[i][0] != '-' && !romPath) romPath = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    vector<uint8_t> caseRom;
+    if(caseName) {
+        for(const auto &builtin : CASES) {
+            if(!strcmp(caseName, builtin.name))
+                caseRom = builtin.build();
+        }
+    }
+    //Exactly one of a ROM file and a known case
+    if((romPath ? caseName != nullptr : caseRom.empty()) || ipf <= 0 || frames <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    inputLog input;
+    if(inputPath) {
+        if(!input.load(inputPath))
+            return 1;
+        seed = input.seed;
+        ipf = input.instructionsPerFrame;
+        frames = (input.endCycle + ipf - 1) / ipf;
+    }
+
+    chip8 reference;
+    chip8 tested;
+    reference.setMode(input.mode);          //Classic and default quirks unless the input log says otherwise
+    tested.setMode(input.mode);
+    reference.setQuirks(input.quirks);
+    tested.setQuirks(input.quirks);
+    if(caseName ? !reference.loadROM(caseRom.data(), caseRom.size()) || !tested.loadROM(caseRom.data(), caseRom.size())
+                : !reference.loadROM(romPath) || !tested.loadROM(romPath))
+        return 1;
+    if(inputPath && inputLog::hashMemory(reference) != input.memoryHash) {
+        cerr << "Input log was recorded with a different ROM!" << endl;
+        return 1;
+    }
+    reference.setSeed(seed);
+    tested.setSeed(seed);
+    tested.setEngine(engine);
+
+    size_t nextChange = 0;
+    chip8State frameStart;
+    chip8State testedStart;
+    for(long long frame = 0; frame < frames; frame++) {
+        uint64_t frameEnd = reference.getCycles() + ipf;
+        reference.saveState(frameStart);
+        tested.saveState(testedStart);
+        size_t frameChange = nextChange;
+
+        //Run the frame in chunks that end at input changes, or at every instruction
+        while(reference.getCycles() < frameEnd) {
+            for(; nextChange < input.changes.size() && input.changes[nextChange].cycle <= reference.getCycles(); nextChange++)
+                applyKeys(reference, tested, input.changes[nextChange].keys);
+            uint64_t chunkEnd = frameEnd;
+            if(nextChange < input.changes.size() && input.changes[nextChange].cycle < chunkEnd)
+                chunkEnd = input.changes[nextChange].cycle;
+            if(perInstruction) {
+                chip8State before;
+                reference.saveState(before);
+                reference.runCycles(1);
+                tested.runCycles(1);
+                chip8State a = comparable(reference), b = comparable(tested);
+                if(!sameState(a, b)) {
+                    reportDivergence(before, reference, tested);
+                    return 2;
+                }
+            } else {
+                reference.runCycles(chunkEnd - reference.getCycles());
+                tested.runCycles(chunkEnd - tested.getCycles());
+            }
+        }
+        reference.decrementCounters();
+        tested.decrementCounters();
+
+        chip8State a = comparable(reference), b = comparable(tested);
+        if(sameState(a, b))
+            continue;
+        if(perInstruction) {
+            printf("divergence in the timer tick at the end of frame %lld\n", frame);
+            reportFields(a, b);
+            return 2;
+        }
+
+        //Re-run the frame one instruction at a time to find the first bad one
+        reference.loadState(frameStart);
+        tested.loadState(testedStart);
+        nextChange = frameChange;
+        while(reference.getCycles() < frameEnd) {
+            for(; nextChange < input.changes.size() && input.changes[nextChange].cycle <= reference.getCycles(); nextChange++)
+                applyKeys(reference, tested, input.changes[nextChange].keys);
+            chip8State before;
+            reference.saveState(before);
+            reference.runCycles(1);
+            tested.runCycles(1);
+            a = comparable(reference);
+            b = comparable(tested);
+            if(!sameState(a, b)) {
+                reportDivergence(before, reference, tested);
+                return 2;
+            }
+        }
+        printf("divergence in frame %lld that does not reproduce one instruction at a time\n", frame);
+        reportFields(comparable(reference), comparable(tested));
+        return 2;
+    }
+    printf("no divergence in %lld frames (%llu instructions)\n", frames, (unsigned long long)reference.getCycles());
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include "../src/CHIP8.hpp"
+#include "../src/romarchive.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* chip8-pack
+ * Builds a ROM archive (see romarchive.hpp) from every ROM under one or more directories, or
+ * lists the index of an existing archive.
+ *
+ * ROMs are the files ending in .ch8 or .c8 (CHIP-8), .sc8 (SUPER-CHIP) and .xo8 (XO-CHIP), the
+ * extension sets the recommended mode and quirks profile. A metadata file overrides them per ROM,
+ * one "<name> [mode=M] [quirks=Q] [ipf=N]" line each, name as stored (relative to its directory).
+ * '#' starts a comment.
+ *
+ * Usage: chip8-pack <archive> <directory>... [--meta FILE] [--ipf N]
+ *        chip8-pack --list <archive>
+ */
+
+static const char *const MODE_NAMES[] = {"chip8", "schip", "xochip"};
+static const char *const QUIRKS_NAMES[] = {"default", "vip", "chip48", "schip", "xochip"};
+
+// Print usage to stderr
+static void usage(const char *name) {
+    cerr << "Usage: " << name << " <archive> <directory>... [--meta FILE] [--ipf N]" << endl
+         << "       " << name << " --list <archive>" << endl
+         << "  --meta FILE  per-ROM \"<name> [mode=M] [quirks=Q] [ipf=N]\" lines" << endl
+         << "  --ipf N      instructions per frame recorded for ROMs without one (default: none)" << endl
+         << "  --list       print hash, size, mode, quirks, ipf and name of every ROM in an archive" << endl;
+}
+
+// Index of text in names, -1 if it is not there
+static int lookup(const char *const *names, int count, const string &text) {
+    for(int i = 0; i < count; i++) {
+        if(text == names[i])
+            return i;
+    }
+    return -1;
+}
+
+// Recommended settings of a ROM, from its extension
+static bool classify(const filesystem::path &path, romRecord &rom) {
+    string extension = path.extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(tolower(c)); });
+    if(extension == ".ch8" || extension == ".c8")
+        return true;
+    if(extension == ".sc8") {
+        rom.mode = Mode::SuperChip;
+        rom.quirks = Quirks::SuperChip;
+        return true;
+    }
+    if(extension == ".xo8") {
+        rom.mode = Mode::XoChip;
+        rom.quirks = Quirks::XoChip;
+        return true;
+    }
+    return false;
+}
+
+// Apply a metadata file to the collected ROMs, false on a malformed line
+static bool applyMetadata(const char *path, vector<romRecord> &roms) {
+    ifstream input(path);
+    if(!input) {
+        cerr << "Could not open metadata file " << path << endl;
+        return false;
+    }
+    map<string, size_t> byName;
+    for(size_t i = 0; i < roms.size(); i++)
+        byName[roms[i].name] = i;
+    string line;
+    for(int lineNumber = 1; getline(input, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        istringstream fields(line);
+        string name, field;
+        if(!(fields >> name))
+            continue;
+        auto rom = byName.find(name);
+        if(rom == byName.end()) {
+            cerr << path << ":" << lineNumber << ": no ROM named " << name << endl;
+            continue;
+        }
+        while(fields >> field) {
+            size_t equals = field.find('=');
+            string key = field.substr(0, equals), value = equals == string::npos ? "" : field.substr(equals + 1);
+            int mode = lookup(MODE_NAMES, 3, value), quirks = lookup(QUIRKS_NAMES, 5, value);
+            if(key == "mode" && mode >= 0) roms[rom->second].mode = Mode(mode);
+            else if(key == "quirks" && quirks >= 0) roms[rom->second].quirks = Quirks(quirks);
+            else if(key == "ipf" && atoi(value.c_str()) > 0) roms[rom->second].instructionsPerFrame = min(atoi(value.c_str()), 0xFFFF);
+            else {
+                cerr << path << ":" << lineNumber << ": expected mode=chip8|schip|xochip, quirks=PROFILE or ipf=N" << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Print the index of an archive
+static int listArchive(const char *path) {
+    romArchive archive;
+    if(!archive.open(path))
+        return 1;
+    size_t bytes = 0;
+    for(size_t i = 0; i < archive.size(); i++) {
+        const romEntry &entry = archive.entry(i);
+        printf("%016llx %6u %-6s %-7s %5u %s\n", (unsigned long long)entry.hash, entry.size, MODE_NAMES[entry.mode],
+               QUIRKS_NAMES[entry.quirks], entry.instructionsPerFrame, archive.name(entry).c_str());
+        bytes += entry.size;
+    }
+    printf("%zu ROMs, %zu bytes\n", archive.size(), bytes);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 3 && !strcmp(argv[1], "--list"))
+        return listArchive(argv[2]);
+    const char *archivePath = nullptr;
+    const char *metaPath = nullptr;
+    vector<string> directories;
+    int ipf = 0;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--meta") && i + 1 < argc) metaPath = argv[++i];
+        else if(!strcmp(argv[i], "--ipf") && i + 1 < argc) ipf = atoi(argv[++i]);
+        else if(argv[i][0] != '-' && !archivePath) archivePath = argv[i];
+        else if(argv[i][0] != '-') directories.push_back(argv[i]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(!archivePath || directories.empty() || ipf < 0 || ipf > 0xFFFF) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    //Directory order is not defined, names are sorted so the same tree always packs the same way
+    vector<romRecord> roms;
+    for(const string &directory : directories) {
+        error_code error;
+        vector<filesystem::path> paths;
+        for(filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+            if(it->is_regular_file())
+                paths.push_back(it->path());
+        }
+        if(error) {
+            cerr << "Could not read directory " << directory << ": " << error.message() << endl;
+            return 1;
+        }
+        sort(paths.begin(), paths.end());
+        for(const filesystem::path &path : paths) {
+            romRecord rom;
+            rom.instructionsPerFrame = ipf;
+            if(!classify(path, rom))
+                continue;
+            rom.name = path.lexically_relative(directory).generic_string();
+            ifstream input(path, ifstream::binary);
+            if(!input) {
+                cerr << "Could not open " << path.string() << endl;
+                return 1;
+            }
+            rom.data.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+            roms.push_back(move(rom));
+        }
+    }
+    if(metaPath && !applyMetadata(metaPath, roms))
+        return 1;
+    roms.erase(remove_if(roms.begin(), roms.end(), [](const romRecord &rom) {
+        size_t capacity = (rom.mode == Mode::XoChip ? MEMORY_SIZE : 4096) - 0x0200;
+        if(rom.data.size() > capacity)
+            cerr << "Skipping " << rom.name << ", too large for its mode" << endl;
+        return rom.data.size() > capacity;
+    }), roms.end());
+
+    //Reading the archive back checks it and counts what was kept after removing duplicates
+    romArchive packed;
+    if(!romArchive::write(archivePath, move(roms)) || !packed.open(archivePath))
+        return 1;
+    cout << "Packed " << packed.size() << " ROMs into " << archivePath << endl;
+    return 0;
+}